@@ -1,10 +1,18 @@
 
 #include "fecpp.h"
 
+#if defined(FECPP_IS_X86)
+
 namespace fecpp {
 
 bool has_sse2() { return true; }
 
 bool has_ssse3() { return true; }
 
+bool has_sse42() { return __builtin_cpu_supports("sse4.2"); }
+
+bool has_avx2() { return __builtin_cpu_supports("avx2"); }
+
 }
+
+#endif
@@ -11,6 +11,9 @@
 #include "fecpp.h"
 #include <stdexcept>
 #include <vector>
+#include <algorithm>
+#include <mutex>
+#include <thread>
 #include <cstring>
 
 namespace fecpp {
@@ -135,80 +138,141 @@ const uint8_t GF_INVERSE[256] = {
 
 static uint8_t GF_MUL_TABLE[256][256];
 
-void init_fec()
+bool build_mul_table()
    {
-   static bool fec_initialized = false;
+   for(size_t i = 0; i != 256; ++i)
+      for(size_t j = 0; j != 256; ++j)
+         GF_MUL_TABLE[i][j] = GF_EXP[(GF_LOG[i] + GF_LOG[j]) % 255];
 
-   if(!fec_initialized)
-      {
-      fec_initialized = true;
+   for(size_t i = 0; i != 256; ++i)
+      GF_MUL_TABLE[0][i] = GF_MUL_TABLE[i][0] = 0;
 
-      for(size_t i = 0; i != 256; ++i)
-         for(size_t j = 0; j != 256; ++j)
-            GF_MUL_TABLE[i][j] = GF_EXP[(GF_LOG[i] + GF_LOG[j]) % 255];
+   return true;
+   }
 
-      for(size_t i = 0; i != 256; ++i)
-         GF_MUL_TABLE[0][i] = GF_MUL_TABLE[i][0] = 0;
-      }
+void init_fec()
+   {
+   /*
+   * Initialization of a local static happens exactly once, even if
+   * several threads create codes at the same time
+   */
+   static const bool fec_initialized = build_mul_table();
+   (void)fec_initialized;
+   }
+
+/*
+* addmul() over the 16 bytes at z, changing only bytes first...last-1
+*/
+void addmul_window(uint8_t z[], const uint8_t x[], uint8_t y,
+                   size_t first, size_t last)
+   {
+#if defined(FECPP_IS_X86)
+   if(has_ssse3())
+      return addmul_ssse3_window(z, x, y, first, last);
+#endif
+
+   addmul_generic_window(z, x, y, first, last);
    }
 
 /*
 * addmul() computes z[] = z[] + x[] * y
+*
+* Everything is done 16 bytes at a time. The ends of buffers that are
+* not a multiple of 16 bytes are handled by working on the 16 bytes
+* ending (or starting) there and masking off the bytes outside, and
+* buffers under 16 bytes are copied to a 16 byte buffer.
 */
 void addmul(uint8_t z[], const uint8_t x[], uint8_t y, size_t size)
    {
-   if(y == 0)
+   if(y == 0 || size == 0)
       return;
 
-   const uint8_t* GF_MUL_Y = GF_MUL_TABLE[y];
-
-   while(size && (uintptr_t)z % 16) // first align z to 16 bytes
+   if(size < 16)
       {
-      z[0] ^= GF_MUL_Y[x[0]];
-      ++z;
-      ++x;
-      size--;
+      uint8_t zb[16] = { 0 }, xb[16] = { 0 };
+      std::memcpy(zb, z, size);
+      std::memcpy(xb, x, size);
+      addmul_window(zb, xb, y, 0, size);
+      std::memcpy(z, zb, size);
+      return;
       }
 
 #if defined(FECPP_IS_X86)
+   if((uintptr_t)z % 16) // first align z to 16 bytes
+      {
+      const size_t head = 16 - (uintptr_t)z % 16;
+      addmul_window(z, x, y, 0, head);
+      z += head;
+      x += head;
+      size -= head;
+      }
+
    if(size >= 16 && has_ssse3())
       {
-      size = addmul_ssse3(z, x, y, size);
+      const size_t consumed = size - addmul_ssse3(z, x, y, size);
+      z += consumed;
+      x += consumed;
+      size -= consumed;
       }
 
    if(size >= 64 && has_sse2())
       {
-      size = addmul_sse2(z, x, y, size);
+      const size_t consumed = size - addmul_sse2(z, x, y, size);
+      z += consumed;
+      x += consumed;
+      size -= consumed;
+      }
+#endif
+
+   if(size >= 16)
+      {
+      const size_t consumed = size - addmul_generic(z, x, y, size);
+      z += consumed;
+      x += consumed;
+      size -= consumed;
       }
+
+   // The trailing bytes are the end of the last 16 byte window
+   if(size)
+      addmul_window(z + size - 16, x + size - 16, y, 16 - size, 16);
+   }
+
+/*
+* dot_mismatch() returns the offset of the first byte where p[]
+* differs from the sum of x[j][] * y[j] for j < n, or size if none
+*/
+size_t dot_mismatch(const uint8_t p[], const uint8_t* const x[],
+                    const uint8_t y[], size_t n, size_t size)
+   {
+   size_t done = 0;
+
+#if defined(FECPP_IS_X86)
+   if(has_ssse3())
+      done = dot_compare_ssse3(p, x, y, n, size);
 #endif
 
-   while(size >= 16)
+   /*
+   Handle the tail, or find the exact offset of a difference, a small
+   tile at a time
+   */
+   uint8_t tile[256];
+
+   while(done != size)
       {
-      z[0] ^= GF_MUL_Y[x[0]];
-      z[1] ^= GF_MUL_Y[x[1]];
-      z[2] ^= GF_MUL_Y[x[2]];
-      z[3] ^= GF_MUL_Y[x[3]];
-      z[4] ^= GF_MUL_Y[x[4]];
-      z[5] ^= GF_MUL_Y[x[5]];
-      z[6] ^= GF_MUL_Y[x[6]];
-      z[7] ^= GF_MUL_Y[x[7]];
-      z[8] ^= GF_MUL_Y[x[8]];
-      z[9] ^= GF_MUL_Y[x[9]];
-      z[10] ^= GF_MUL_Y[x[10]];
-      z[11] ^= GF_MUL_Y[x[11]];
-      z[12] ^= GF_MUL_Y[x[12]];
-      z[13] ^= GF_MUL_Y[x[13]];
-      z[14] ^= GF_MUL_Y[x[14]];
-      z[15] ^= GF_MUL_Y[x[15]];
+      const size_t len = std::min(sizeof(tile), size - done);
+
+      std::memset(tile, 0, len);
+      for(size_t j = 0; j != n; ++j)
+         addmul(tile, x[j] + done, y[j], len);
+
+      for(size_t i = 0; i != len; ++i)
+         if(tile[i] != p[done + i])
+            return done + i;
 
-      x += 16;
-      z += 16;
-      size -= 16;
+      done += len;
       }
 
-   // Clean up the trailing pieces
-   for(size_t i = 0; i != size; ++i)
-      z[i] ^= GF_MUL_Y[x[i]];
+   return size;
    }
 
 /*
@@ -269,8 +333,8 @@ void invert_matrix(uint8_t matrix[], size_t K)
 
       std::pair<size_t, size_t> icolrow = pivot_search(col, matrix);
 
-      size_t icol = icolrow.first;
-      size_t irow = icolrow.second;
+      size_t icol = icolrow.second;
+      size_t irow = icolrow.first;
 
       /*
       * swap rows irow and icol, so afterwards the diagonal
@@ -332,12 +396,12 @@ void invert_matrix(uint8_t matrix[], size_t K)
       id_row[icol] = 0;
       } /* done all columns */
 
-   for(size_t i = 0; i != K; ++i)
+   for(size_t i = K; i != 0; --i)
       {
-      if(indxr[i] != indxc[i])
+      if(indxr[i-1] != indxc[i-1])
          {
          for(size_t row = 0; row != K; ++row)
-            std::swap(matrix[row*K + indxr[i]], matrix[row*K + indxc[i]]);
+            std::swap(matrix[row*K + indxr[i-1]], matrix[row*K + indxc[i-1]]);
          }
       }
    }
@@ -403,6 +467,316 @@ void create_inverted_vdm(uint8_t vdm[], size_t K)
       }
    }
 
+/*
+* Tables for computing CRC32C (reflected polynomial 0x82F63B78) eight
+* bytes at a time, for CPUs without the crc32 instruction
+*/
+uint32_t CRC32C_TABLE[8][256];
+
+bool build_crc32c_table()
+   {
+   for(uint32_t n = 0; n != 256; ++n)
+      {
+      uint32_t crc = n;
+      for(size_t k = 0; k != 8; ++k)
+         crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+      CRC32C_TABLE[0][n] = crc;
+      }
+
+   for(size_t n = 0; n != 256; ++n)
+      for(size_t k = 1; k != 8; ++k)
+         CRC32C_TABLE[k][n] = (CRC32C_TABLE[k-1][n] >> 8) ^
+                              CRC32C_TABLE[0][CRC32C_TABLE[k-1][n] & 0xFF];
+
+   return true;
+   }
+
+/*
+* crc32c_update() continues a raw (not inverted) CRC32C state over buf
+*/
+uint32_t crc32c_update(uint32_t crc, const uint8_t buf[], size_t len)
+   {
+#if defined(FECPP_IS_X86)
+   static const bool use_sse42 = has_sse42();
+   if(use_sse42)
+      return crc32c_sse42(crc, buf, len);
+#endif
+
+   static const bool table_built = build_crc32c_table();
+   (void)table_built;
+
+   while(len >= 8)
+      {
+      crc ^= static_cast<uint32_t>(buf[0]) |
+             static_cast<uint32_t>(buf[1]) << 8 |
+             static_cast<uint32_t>(buf[2]) << 16 |
+             static_cast<uint32_t>(buf[3]) << 24;
+
+      crc = CRC32C_TABLE[7][crc & 0xFF] ^
+            CRC32C_TABLE[6][(crc >> 8) & 0xFF] ^
+            CRC32C_TABLE[5][(crc >> 16) & 0xFF] ^
+            CRC32C_TABLE[4][crc >> 24] ^
+            CRC32C_TABLE[3][buf[4]] ^
+            CRC32C_TABLE[2][buf[5]] ^
+            CRC32C_TABLE[1][buf[6]] ^
+            CRC32C_TABLE[0][buf[7]];
+
+      buf += 8;
+      len -= 8;
+      }
+
+   for(size_t i = 0; i != len; ++i)
+      crc = (crc >> 8) ^ CRC32C_TABLE[0][(crc ^ buf[i]) & 0xFF];
+
+   return crc;
+   }
+
+/*
+* Shares are processed in tiles of this size by the encoders and
+* decoders that also checksum or hash them, so each tile is read
+* again while it is still in cache. It is a multiple of the SHA-256
+* block size so the hasher never has to buffer partial blocks.
+*/
+const size_t TILE_SIZE = 4096;
+
+/*
+* Flag which tiles of the K blocks of input hold a nonzero byte; tile
+* t of block j is flags[t*K + j]. A zero tile adds nothing to any
+* parity share, so the encoders check each one once here and then
+* skip it for every parity row. The check stops at the first nonzero
+* byte, so it costs almost nothing on dense data.
+*/
+std::vector<uint8_t> nonzero_tiles(const uint8_t input[], size_t K,
+                                   size_t block_size)
+   {
+   const size_t tiles = (block_size + TILE_SIZE - 1) / TILE_SIZE;
+
+   std::vector<uint8_t> flags(tiles * K);
+
+   for(size_t t = 0; t != tiles; ++t)
+      {
+      const size_t done = t * TILE_SIZE;
+      const size_t len = std::min(TILE_SIZE, block_size - done);
+
+      for(size_t j = 0; j != K; ++j)
+         flags[t*K + j] = !is_zero(input + j*block_size + done, len);
+      }
+
+   return flags;
+   }
+
+/*
+* Add y times the virtual share of a packet (its length as 2 bytes big
+* endian, then its contents, then zeros) to out
+*/
+void addmul_packet(uint8_t out[], const uint8_t packet[], size_t length,
+                   uint8_t y)
+   {
+   out[0] ^= GF_MUL_TABLE[y][(length >> 8) & 0xFF];
+   out[1] ^= GF_MUL_TABLE[y][length & 0xFF];
+   addmul(out + 2, packet, y, length);
+   }
+
+/*
+* Incremental Gauss-Jordan elimination, used by the decoders that
+* accept their inputs one at a time.
+*
+* The system has cols unknowns, each a region of size bytes. If
+* have[c] is set, row c of matrix (cols*cols coefficients) and of
+* rows (cols*size bytes) holds the equation whose pivot is column c.
+* Every such row is normalized, and is zero in all other pivot
+* columns, so a row that is zero except for its pivot is solved.
+*
+* add_equation() reduces a new equation against the rows already
+* present. If it is independent of them, it is added and its pivot
+* column returned, otherwise cols is returned. coef is clobbered.
+*/
+size_t add_equation(uint8_t matrix[], uint8_t rows[],
+                    std::vector<bool>& have, size_t cols, size_t size,
+                    uint8_t coef[], const uint8_t data[])
+   {
+   /*
+   Since the existing rows are fully reduced, the multiple of row c to
+   remove is just the new equation's coefficient in column c
+   */
+   std::vector<uint8_t> mult(cols);
+
+   for(size_t c = 0; c != cols; ++c)
+      {
+      if(have[c] && coef[c] != 0)
+         {
+         mult[c] = coef[c];
+         addmul(coef, &matrix[c*cols], coef[c], cols);
+         }
+      }
+
+   size_t pivot = 0;
+   while(pivot != cols && coef[pivot] == 0)
+      ++pivot;
+
+   if(pivot == cols)
+      return cols; // linearly dependent on what we already have
+
+   const uint8_t* mul_inv = GF_MUL_TABLE[GF_INVERSE[coef[pivot]]];
+
+   uint8_t* pivot_row = &matrix[pivot*cols];
+   for(size_t c = 0; c != cols; ++c)
+      pivot_row[c] = mul_inv[coef[c]];
+
+   uint8_t* pivot_data = &rows[pivot*size];
+   std::memset(pivot_data, 0, size);
+   addmul(pivot_data, data, mul_inv[1], size);
+   for(size_t c = 0; c != cols; ++c)
+      if(mult[c])
+         addmul(pivot_data, &rows[c*size], mul_inv[mult[c]], size);
+
+   // now remove the new pivot column from all the other rows
+   for(size_t r = 0; r != cols; ++r)
+      {
+      const uint8_t c = matrix[r*cols + pivot];
+
+      if(!have[r] || c == 0)
+         continue;
+
+      addmul(&matrix[r*cols], pivot_row, c, cols);
+      addmul(&rows[r*size], pivot_data, c, size);
+      }
+
+   have[pivot] = true;
+   return pivot;
+   }
+
+/*
+* The coefficient of source packet seq in repair packet repair_id of a
+* sliding window code; a hash of the two, mapped to a nonzero element
+*/
+uint8_t window_coefficient(uint64_t repair_id, uint64_t seq)
+   {
+   uint64_t x = repair_id * 0x9E3779B97F4A7C15ULL + seq;
+   x ^= x >> 31;
+   x *= 0xBF58476D1CE4E5B9ULL;
+   x ^= x >> 29;
+   x *= 0x94D049BB133111EBULL;
+   x ^= x >> 32;
+   return static_cast<uint8_t>(1 + x % 255);
+   }
+
+/*
+* Fill coef with random coefficients, not all zero, for the random
+* linear codes. xorshift64* is plenty for this.
+*/
+void random_coefficients(uint64_t& state, uint8_t coef[], size_t n)
+   {
+   bool nonzero = false;
+
+   while(!nonzero)
+      {
+      for(size_t i = 0; i != n; ++i)
+         {
+         state ^= state >> 12;
+         state ^= state << 25;
+         state ^= state >> 27;
+         coef[i] = static_cast<uint8_t>((state * 0x2545F4914F6CDD1DULL) >> 56);
+         nonzero = nonzero || coef[i] != 0;
+         }
+      }
+   }
+
+/*
+* Check if the row with pivot column c has been solved
+*/
+bool equation_solved(const uint8_t matrix[], size_t cols, size_t c)
+   {
+   for(size_t i = 0; i != cols; ++i)
+      if(i != c && matrix[c*cols + i] != 0)
+         return false;
+   return true;
+   }
+
+/*
+* Berlekamp-Massey: find the shortest linear recurrence generating the
+* syndromes S[0...n). Its connection polynomial (conn[0] = 1) is the
+* error locator, whose roots are the inverses of the error locations.
+* Returns the length L of the recurrence; conn is given L+1 coefficients,
+* of which the last may be zero.
+*/
+size_t berlekamp_massey(const uint8_t S[], size_t n,
+                        std::vector<uint8_t>& conn)
+   {
+   conn.assign(n + 1, 0);
+   conn[0] = 1;
+   std::vector<uint8_t> prev(conn), tmp;
+
+   size_t L = 0, shift = 1;
+   uint8_t prev_d = 1;
+
+   for(size_t i = 0; i != n; ++i)
+      {
+      uint8_t d = S[i];
+      for(size_t j = 1; j <= L; ++j)
+         d ^= GF_MUL_TABLE[conn[j]][S[i-j]];
+
+      if(d == 0)
+         {
+         ++shift;
+         continue;
+         }
+
+      const uint8_t* coef = GF_MUL_TABLE[GF_MUL_TABLE[d][GF_INVERSE[prev_d]]];
+
+      if(2*L <= i)
+         tmp = conn;
+
+      for(size_t j = 0; j + shift <= n; ++j)
+         conn[j + shift] ^= coef[prev[j]];
+
+      if(2*L <= i)
+         {
+         L = i + 1 - L;
+         prev.swap(tmp);
+         prev_d = d;
+         shift = 1;
+         }
+      else
+         ++shift;
+      }
+
+   conn.resize(L + 1);
+   return L;
+   }
+
+/*
+* Check if the syndromes S[0...n) satisfy the recurrence given by the
+* connection polynomial conn
+*/
+bool satisfies_recurrence(const std::vector<uint8_t>& conn,
+                          const uint8_t S[], size_t n)
+   {
+   const size_t L = conn.size() - 1;
+
+   for(size_t i = L; i < n; ++i)
+      {
+      uint8_t d = 0;
+      for(size_t j = 0; j <= L; ++j)
+         d ^= GF_MUL_TABLE[conn[j]][S[i-j]];
+      if(d)
+         return false;
+      }
+
+   return true;
+   }
+
+/*
+* Evaluate the polynomial poly at x
+*/
+uint8_t poly_eval(const std::vector<uint8_t>& poly, uint8_t x)
+   {
+   uint8_t y = 0;
+   for(size_t i = poly.size(); i != 0; --i)
+      y = GF_MUL_TABLE[y][x] ^ poly[i-1];
+   return y;
+   }
+
 }
 
 /*
@@ -422,28 +796,39 @@ fec_code::fec_code(size_t K_arg, size_t N_arg) :
    if(K == 0 || N == 0 || K > 256 || N > 256 || K > N)
       throw std::invalid_argument("fec_code: violated 1 <= K <= N <= 256");
 
+   /*
+   * the upper part of the encoding matrix is I
+   */
+   for(size_t i = 0; i != K; ++i)
+      enc_matrix[i*(K+1)] = 1;
+
+   build_parity_rows(K);
+   }
+
+/*
+* Compute rows first...N-1 of the encoding matrix
+*/
+void fec_code::build_parity_rows(size_t first)
+   {
    std::vector<uint8_t> temp_matrix(N * K);
 
    /*
    * quick code to build systematic matrix: invert the top
    * K*K vandermonde matrix, multiply right the bottom n-K rows
    * by the inverse, and construct the identity matrix at the top.
+   *
+   * Each row of the vandermonde matrix depends only on its index, so
+   * row i of the encoding matrix is the same for any N > i.
    */
    create_inverted_vdm(&temp_matrix[0], K);
 
-   for(size_t i = K*K; i != temp_matrix.size(); ++i)
+   for(size_t i = first*K; i != temp_matrix.size(); ++i)
       temp_matrix[i] = GF_EXP[((i / K) * (i % K)) % 255];
 
-   /*
-   * the upper part of the encoding matrix is I
-   */
-   for(size_t i = 0; i != K; ++i)
-      enc_matrix[i*(K+1)] = 1;
-
    /*
    * computes C = AB where A is n*K, B is K*m, C is n*m
    */
-   for(size_t row = K*K; row != N*K; row += K)
+   for(size_t row = first*K; row != N*K; row += K)
       {
       for(size_t col = 0; col != K; ++col)
          {
@@ -457,6 +842,152 @@ fec_code::fec_code(size_t K_arg, size_t N_arg) :
       }
    }
 
+/*
+* Create a code from a precomputed encoding matrix
+*/
+fec_code::fec_code(size_t K_arg, size_t N_arg, const uint8_t parity_rows[]) :
+   K(K_arg), N(N_arg), enc_matrix(N * K)
+   {
+   init_fec();
+
+   for(size_t i = 0; i != K; ++i)
+      enc_matrix[i*(K+1)] = 1;
+
+   std::memcpy(&enc_matrix[K*K], parity_rows, (N - K) * K);
+   }
+
+namespace {
+
+/*
+* A serialized code is the magic, the version, N-1, K-1, the parity
+* rows of the encoding matrix, then a big endian CRC32C of all that,
+* so a corrupted or foreign blob is rejected instead of loaded as a
+* different code
+*/
+const uint8_t SERIALIZED_MAGIC[4] = { 'F', 'E', 'C', 'M' };
+const uint8_t SERIALIZED_VERSION = 1;
+const size_t SERIALIZED_HEADER = 7;
+const size_t SERIALIZED_TRAILER = 4;
+
+}
+
+/*
+* Serialize the encoding matrix
+*/
+std::vector<uint8_t> fec_code::serialize() const
+   {
+   const size_t matrix_len = (N - K) * K;
+
+   std::vector<uint8_t> out(SERIALIZED_HEADER + matrix_len + SERIALIZED_TRAILER);
+
+   std::memcpy(&out[0], SERIALIZED_MAGIC, 4);
+   out[4] = SERIALIZED_VERSION;
+   out[5] = static_cast<uint8_t>(N - 1);
+   out[6] = static_cast<uint8_t>(K - 1);
+   std::memcpy(&out[SERIALIZED_HEADER], &enc_matrix[K*K], matrix_len);
+
+   const size_t crc_pos = SERIALIZED_HEADER + matrix_len;
+   const uint32_t crc = crc32c(0, &out[0], crc_pos);
+   for(size_t i = 0; i != 4; ++i)
+      out[crc_pos + i] = static_cast<uint8_t>(crc >> (24 - 8*i));
+
+   return out;
+   }
+
+/*
+* Load a serialized encoding matrix
+*/
+fec_code fec_code::deserialize(const uint8_t data[], size_t len)
+   {
+   if(len < SERIALIZED_HEADER + SERIALIZED_TRAILER)
+      throw std::invalid_argument("fec_code::deserialize: truncated input");
+
+   if(std::memcmp(data, SERIALIZED_MAGIC, 4) != 0)
+      throw std::invalid_argument("fec_code::deserialize: bad magic");
+
+   if(data[4] != SERIALIZED_VERSION)
+      throw std::invalid_argument("fec_code::deserialize: unknown version");
+
+   const size_t N = data[5] + 1;
+   const size_t K = data[6] + 1;
+
+   if(K > N)
+      throw std::invalid_argument("fec_code::deserialize: violated K <= N");
+
+   const size_t crc_pos = SERIALIZED_HEADER + (N - K) * K;
+
+   if(len != crc_pos + SERIALIZED_TRAILER)
+      throw std::invalid_argument("fec_code::deserialize: bad length");
+
+   uint32_t crc = 0;
+   for(size_t i = 0; i != 4; ++i)
+      crc = (crc << 8) | data[crc_pos + i];
+
+   if(crc != crc32c(0, data, crc_pos))
+      throw std::invalid_argument("fec_code::deserialize: bad checksum");
+
+   return fec_code(K, N, data + SERIALIZED_HEADER);
+   }
+
+/*
+* Create a code with more (or fewer) shares
+*/
+fec_code fec_code::extended(size_t new_N) const
+   {
+   if(new_N < K || new_N > 256)
+      throw std::invalid_argument("fec_code::extended: violated K <= N <= 256");
+
+   fec_code code(*this);
+
+   code.N = new_N;
+   code.enc_matrix.resize(new_N * K);
+
+   if(new_N > N)
+      code.build_parity_rows(N);
+
+   return code;
+   }
+
+/*
+* Compute a single parity share; out must be zeroed
+*/
+void fec_code::encode_parity(size_t i, const uint8_t input[],
+                             size_t block_size, uint8_t out[]) const
+   {
+   encode_parity(i, input, block_size,
+                 nonzero_tiles(input, K, block_size).data(), out);
+   }
+
+/*
+* Compute a single parity share, skipping the source tiles that
+* nonzero_tiles flagged as zero; a tile where every source is zero is
+* left as zeros. out must be zeroed.
+*/
+void fec_code::encode_parity(size_t i, const uint8_t input[],
+                             size_t block_size, const uint8_t nonzero[],
+                             uint8_t out[]) const
+   {
+   for(size_t t = 0, done = 0; done < block_size; ++t, done += TILE_SIZE)
+      {
+      const size_t len = std::min(TILE_SIZE, block_size - done);
+
+      for(size_t j = 0; j != K; ++j)
+         if(nonzero[t*K + j])
+            addmul(out + done, input + j*block_size + done,
+                   enc_matrix[i*K+j], len);
+      }
+   }
+
+/*
+* Compute parity share i from data blocks which are not contiguous
+*/
+void fec_code::encode_parity(size_t i, const uint8_t* const blocks[],
+                             size_t block_size, uint8_t out[]) const
+   {
+   for(size_t j = 0; j != K; ++j)
+      addmul(out, blocks[j], enc_matrix[i*K+j], block_size);
+   }
+
 /*
 * FEC encoding routine
 */
@@ -474,14 +1005,12 @@ void fec_code::encode(
    for(size_t i = 0; i != K; ++i)
       output(i, N, input + i*block_size, block_size);
 
+   const std::vector<uint8_t> nonzero = nonzero_tiles(input, K, block_size);
+
    for(size_t i = K; i != N; ++i)
       {
       std::vector<uint8_t> fec_buf(block_size);
-
-      for(size_t j = 0; j != K; ++j)
-         addmul(&fec_buf[0], input + j*block_size,
-                enc_matrix[i*K+j], block_size);
-
+      encode_parity(i, input, block_size, nonzero.data(), &fec_buf[0]);
       output(i, N, &fec_buf[0], fec_buf.size());
       }
 #else
@@ -512,12 +1041,252 @@ void fec_code::encode(
    }
 
 /*
-* FEC decoding routine
+* FEC encoding of variable length packets
 */
-void fec_code::decode(
-   const std::map<size_t, const uint8_t*>& shares,
-   size_t share_size,
-   std::function<void (size_t, size_t, const uint8_t[], size_t)> output) const
+void fec_code::encode_packets(
+   const uint8_t* const packets[], const size_t lengths[],
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   size_t max_len = 0;
+   for(size_t j = 0; j != K; ++j)
+      {
+      if(lengths[j] > 0xFFFF)
+         throw std::invalid_argument("encode_packets: packet too long");
+      max_len = std::max(max_len, lengths[j]);
+      }
+
+   for(size_t i = 0; i != K; ++i)
+      output(i, N, packets[i], lengths[i]);
+
+   /*
+   Bytes past the end of a packet are zero, so they add nothing to the
+   parity and are never touched
+   */
+   std::vector<uint8_t> fec_buf(2 + max_len);
+
+   for(size_t i = K; i != N; ++i)
+      {
+      std::fill(fec_buf.begin(), fec_buf.end(), 0);
+      for(size_t j = 0; j != K; ++j)
+         addmul_packet(fec_buf.data(), packets[j], lengths[j], enc_matrix[i*K+j]);
+      output(i, N, fec_buf.data(), fec_buf.size());
+      }
+   }
+
+/*
+* FEC encoding routine that also computes the CRC of each share
+*/
+void fec_code::encode_crc32c(
+   const uint8_t input[], size_t size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t, uint32_t)> output)
+   const
+   {
+   if(size % K != 0)
+      throw std::invalid_argument("encode: input must be multiple of K bytes");
+
+   const size_t block_size = size / K;
+
+   std::vector<std::vector<uint8_t> > fec_buf(N - K);
+   for(size_t i = 0; i != fec_buf.size(); ++i)
+      fec_buf[i].resize(block_size);
+
+   std::vector<uint32_t> crc(N, 0xFFFFFFFF);
+
+   const std::vector<uint8_t> nonzero = nonzero_tiles(input, K, block_size);
+
+   /*
+   Each data tile is checksummed as it is first read, and stays in
+   cache while the parity tiles are computed from it; those are in
+   turn checksummed right after being written
+   */
+   for(size_t t = 0, done = 0; done != block_size; ++t)
+      {
+      const size_t len = std::min(TILE_SIZE, block_size - done);
+
+      for(size_t j = 0; j != K; ++j)
+         crc[j] = crc32c_update(crc[j], input + j*block_size + done, len);
+
+      for(size_t i = K; i != N; ++i)
+         {
+         uint8_t* out = &fec_buf[i-K][done];
+         for(size_t j = 0; j != K; ++j)
+            if(nonzero[t*K + j])
+               addmul(out, input + j*block_size + done, enc_matrix[i*K+j], len);
+         crc[i] = crc32c_update(crc[i], out, len);
+         }
+
+      done += len;
+      }
+
+   for(size_t i = 0; i != K; ++i)
+      output(i, N, input + i*block_size, block_size, ~crc[i]);
+
+   for(size_t i = K; i != N; ++i)
+      output(i, N, fec_buf[i-K].data(), block_size, ~crc[i]);
+   }
+
+/*
+* FEC encoding routine that also hashes each share
+*/
+void fec_code::encode_hashed(
+   const uint8_t input[], size_t size, share_hasher& hasher,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   if(size % K != 0)
+      throw std::invalid_argument("encode: input must be multiple of K bytes");
+
+   if(hasher.get_n() != N)
+      throw std::invalid_argument("encode_hashed: hasher must be for N shares");
+
+   const size_t block_size = size / K;
+
+   std::vector<std::vector<uint8_t> > fec_buf(N - K);
+   for(size_t i = 0; i != fec_buf.size(); ++i)
+      fec_buf[i].resize(block_size);
+
+   std::vector<const uint8_t*> tiles(N);
+
+   const std::vector<uint8_t> nonzero = nonzero_tiles(input, K, block_size);
+
+   for(size_t t = 0, done = 0; done != block_size; ++t)
+      {
+      const size_t len = std::min(TILE_SIZE, block_size - done);
+
+      for(size_t j = 0; j != K; ++j)
+         tiles[j] = input + j*block_size + done;
+
+      for(size_t i = K; i != N; ++i)
+         {
+         uint8_t* out = &fec_buf[i-K][done];
+         for(size_t j = 0; j != K; ++j)
+            if(nonzero[t*K + j])
+               addmul(out, tiles[j], enc_matrix[i*K+j], len);
+         tiles[i] = out;
+         }
+
+      hasher.update(&tiles[0], len);
+
+      done += len;
+      }
+
+   for(size_t i = 0; i != K; ++i)
+      output(i, N, input + i*block_size, block_size);
+
+   for(size_t i = K; i != N; ++i)
+      output(i, N, fec_buf[i-K].data(), block_size);
+   }
+
+/*
+* Check parity shares against the data shares
+*/
+std::map<size_t, size_t> fec_code::verify(const uint8_t* const shares[],
+                                          size_t share_size) const
+   {
+   std::map<size_t, size_t> mismatches;
+
+   for(size_t i = K; i != N; ++i)
+      {
+      if(shares[i] == 0)
+         continue;
+
+      const size_t offset = dot_mismatch(shares[i], shares,
+                                         &enc_matrix[i*K], K, share_size);
+
+      if(offset != share_size)
+         mismatches[i] = offset;
+      }
+
+   return mismatches;
+   }
+
+/*
+* Encode only some of the shares
+*/
+void fec_code::encode_shares(
+   const std::vector<size_t>& share_ids,
+   const uint8_t input[], size_t size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   if(size % K != 0)
+      throw std::invalid_argument("encode_shares: input must be multiple of K bytes");
+
+   const size_t block_size = size / K;
+
+   std::vector<uint8_t> fec_buf(block_size);
+   std::vector<uint8_t> nonzero;
+
+   for(size_t i = 0; i != share_ids.size(); ++i)
+      {
+      const size_t id = share_ids[i];
+
+      if(id >= N)
+         throw std::invalid_argument("encode_shares: invalid share id");
+
+      if(id < K)
+         {
+         output(id, N, input + id*block_size, block_size);
+         continue;
+         }
+
+      if(nonzero.empty())
+         nonzero = nonzero_tiles(input, K, block_size);
+
+      std::fill(fec_buf.begin(), fec_buf.end(), 0);
+      encode_parity(id, input, block_size, nonzero.data(), fec_buf.data());
+      output(id, N, fec_buf.data(), block_size);
+      }
+   }
+
+/*
+* Parity update from a delta
+*/
+void fec_code::update_parity(size_t block, const uint8_t delta[],
+                             size_t size, uint8_t* const parity[]) const
+   {
+   if(block >= K)
+      throw std::invalid_argument("update_parity: invalid block id");
+
+   /*
+   Each parity share is a linear function of the data blocks, so
+   changing block j by delta changes parity i by E[i][j] * delta
+   */
+   for(size_t i = K; i != N; ++i)
+      addmul(parity[i-K], delta, enc_matrix[i*K + block], size);
+   }
+
+/*
+* Parity update from the old and new contents
+*/
+void fec_code::update_parity(size_t block,
+                             const uint8_t old_data[],
+                             const uint8_t new_data[],
+                             size_t size, uint8_t* const parity[]) const
+   {
+   if(block >= K)
+      throw std::invalid_argument("update_parity: invalid block id");
+
+   /*
+   E[i][j] * (old ^ new) is E[i][j] * old ^ E[i][j] * new, so the
+   delta never needs to be formed
+   */
+   for(size_t i = K; i != N; ++i)
+      {
+      addmul(parity[i-K], old_data, enc_matrix[i*K + block], size);
+      addmul(parity[i-K], new_data, enc_matrix[i*K + block], size);
+      }
+   }
+
+/*
+* Choose K shares to decode from and set up the decoding matrix
+*/
+void fec_code::decode_setup(
+   const std::map<size_t, const uint8_t*>& shares,
+   std::vector<uint8_t>& m_dec,
+   std::vector<size_t>& indexes,
+   std::vector<const uint8_t*>& sharesv) const
    {
    /*
    Todo:
@@ -531,9 +1300,9 @@ void fec_code::decode(
    if(shares.size() < K)
       throw std::logic_error("Could not decode, less than K surviving shares");
 
-   std::vector<uint8_t> m_dec(K * K);
-   std::vector<size_t> indexes(K);
-   std::vector<const uint8_t*> sharesv(K);
+   m_dec.assign(K * K, 0);
+   indexes.resize(K);
+   sharesv.resize(K);
 
    std::map<size_t, const uint8_t*>::const_iterator shares_b_iter =
       shares.begin();
@@ -564,15 +1333,12 @@ void fec_code::decode(
 
       /*
       This is a systematic code (encoding matrix includes K*K identity
-      matrix), so shares less than K are copies of the input data,
-      can output directly. Also we know the encoding matrix in those rows
-      contains I, so we can set the single bit directly without copying
+      matrix), so shares less than K are copies of the input data.
+      Also we know the encoding matrix in those rows contains I, so we
+      can set the single bit directly without copying
       */
       if(share_id < K)
-         {
          m_dec[i*(K+1)] = 1;
-         output(share_id, K, share_data, share_size);
-         }
       else // will decode after inverting matrix
          std::memcpy(&m_dec[i*K], &(enc_matrix[share_id*K]), K);
 
@@ -585,6 +1351,30 @@ void fec_code::decode(
    and return immediately
    */
    invert_matrix(&m_dec[0], K);
+   }
+
+/*
+* FEC decoding routine
+*/
+void fec_code::decode(
+   const std::map<size_t, const uint8_t*>& shares,
+   size_t share_size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output) const
+   {
+   std::vector<uint8_t> m_dec;
+   std::vector<size_t> indexes;
+   std::vector<const uint8_t*> sharesv;
+
+   decode_setup(shares, m_dec, indexes, sharesv);
+
+   /*
+   Shares less than K are copies of the input data, output directly
+   */
+   for(size_t i = 0; i != indexes.size(); ++i)
+      {
+      if(indexes[i] < K)
+         output(indexes[i], K, sharesv[i], share_size);
+      }
 
    for(size_t i = 0; i != indexes.size(); ++i)
       {
@@ -598,4 +1388,1633 @@ void fec_code::decode(
       }
    }
 
+/*
+* FEC decoding of variable length packets
+*/
+void fec_code::decode_packets(
+   const std::map<size_t, std::pair<const uint8_t*, size_t> >& shares,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   std::map<size_t, const uint8_t*> share_ptrs;
+   size_t parity_len = 0;
+
+   for(auto s = shares.begin(); s != shares.end(); ++s)
+      {
+      share_ptrs[s->first] = s->second.first;
+
+      if(s->first < K)
+         {
+         if(s->second.second > 0xFFFF)
+            throw std::invalid_argument("decode_packets: packet too long");
+         continue;
+         }
+
+      if(parity_len != 0 && s->second.second != parity_len)
+         throw std::invalid_argument("decode_packets: parity shares differ in length");
+
+      if(s->second.second < 2)
+         throw std::invalid_argument("decode_packets: parity share too short");
+
+      parity_len = s->second.second;
+      }
+
+   std::vector<uint8_t> m_dec;
+   std::vector<size_t> indexes;
+   std::vector<const uint8_t*> sharesv;
+
+   decode_setup(share_ptrs, m_dec, indexes, sharesv);
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] < K)
+         output(i, K, sharesv[i], shares.find(i)->second.second);
+      }
+
+   std::vector<uint8_t> buf(parity_len);
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] < K)
+         continue;
+
+      std::fill(buf.begin(), buf.end(), 0);
+
+      for(size_t col = 0; col != K; ++col)
+         {
+         const size_t len = shares.find(indexes[col])->second.second;
+
+         if(indexes[col] < K)
+            {
+            if(len + 2 > parity_len)
+               throw std::invalid_argument("decode_packets: packet longer than parity");
+            addmul_packet(buf.data(), sharesv[col], len, m_dec[i*K + col]);
+            }
+         else
+            addmul(buf.data(), sharesv[col], m_dec[i*K + col], len);
+         }
+
+      const size_t length = (static_cast<size_t>(buf[0]) << 8) | buf[1];
+
+      if(length + 2 > parity_len)
+         throw std::logic_error("decode_packets: recovered an invalid length");
+
+      output(i, K, buf.data() + 2, length);
+      }
+   }
+
+/*
+* FEC decoding routine that also computes the CRC of each block
+*/
+void fec_code::decode_crc32c(
+   const std::map<size_t, const uint8_t*>& shares,
+   size_t share_size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t, uint32_t)> output)
+   const
+   {
+   std::vector<uint8_t> m_dec;
+   std::vector<size_t> indexes;
+   std::vector<const uint8_t*> sharesv;
+
+   decode_setup(shares, m_dec, indexes, sharesv);
+
+   std::vector<std::vector<uint8_t> > bufs(K);
+   for(size_t i = 0; i != K; ++i)
+      if(indexes[i] >= K)
+         bufs[i].resize(share_size);
+
+   std::vector<uint32_t> crc(K, 0xFFFFFFFF);
+
+   for(size_t done = 0; done != share_size; )
+      {
+      const size_t len = std::min(TILE_SIZE, share_size - done);
+
+      for(size_t i = 0; i != K; ++i)
+         {
+         if(indexes[i] < K)
+            {
+            crc[i] = crc32c_update(crc[i], sharesv[i] + done, len);
+            continue;
+            }
+
+         uint8_t* out = &bufs[i][done];
+         for(size_t col = 0; col != K; ++col)
+            addmul(out, sharesv[col] + done, m_dec[i*K + col], len);
+         crc[i] = crc32c_update(crc[i], out, len);
+         }
+
+      done += len;
+      }
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] < K)
+         output(i, K, sharesv[i], share_size, ~crc[i]);
+      }
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] >= K)
+         output(i, K, bufs[i].data(), share_size, ~crc[i]);
+      }
+   }
+
+/*
+* FEC decoding routine that also hashes each share
+*/
+void fec_code::decode_hashed(
+   const std::map<size_t, const uint8_t*>& shares,
+   size_t share_size, share_hasher& hasher,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   if(hasher.get_n() != N)
+      throw std::invalid_argument("decode_hashed: hasher must be for N shares");
+
+   for(auto s = shares.begin(); s != shares.end(); ++s)
+      if(s->first >= N)
+         throw std::logic_error("Invalid share id detected during decode");
+
+   std::vector<uint8_t> m_dec;
+   std::vector<size_t> indexes;
+   std::vector<const uint8_t*> sharesv;
+
+   decode_setup(shares, m_dec, indexes, sharesv);
+
+   std::vector<std::vector<uint8_t> > bufs(K);
+   for(size_t i = 0; i != K; ++i)
+      if(indexes[i] >= K)
+         bufs[i].resize(share_size);
+
+   std::vector<const uint8_t*> tiles(N);
+
+   for(size_t done = 0; done != share_size; )
+      {
+      const size_t len = std::min(TILE_SIZE, share_size - done);
+
+      for(size_t i = 0; i != K; ++i)
+         {
+         if(indexes[i] < K)
+            continue;
+
+         for(size_t col = 0; col != K; ++col)
+            addmul(&bufs[i][done], sharesv[col] + done, m_dec[i*K + col], len);
+         }
+
+      for(auto s = shares.begin(); s != shares.end(); ++s)
+         tiles[s->first] = s->second + done;
+
+      hasher.update(&tiles[0], len);
+
+      done += len;
+      }
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] < K)
+         output(i, K, sharesv[i], share_size);
+      }
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] >= K)
+         output(i, K, bufs[i].data(), share_size);
+      }
+   }
+
+/*
+* Decode, locating and ignoring corrupted shares
+*/
+std::vector<size_t> fec_code::decode_correcting(
+   const std::map<size_t, const uint8_t*>& shares,
+   size_t share_size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output) const
+   {
+   if(shares.size() < K)
+      throw std::logic_error("Could not decode, less than K surviving shares");
+
+   /*
+   Share i is the value at X_i of the polynomial of degree < K which
+   takes the value of the data blocks at X_0...X_{K-1}, with X_0 = 0
+   and X_i = a^i otherwise. So the available shares form a (possibly
+   shortened) Reed-Solomon codeword, and syndrome decoding applies.
+   */
+   std::vector<size_t> ids;
+   std::vector<const uint8_t*> ptrs;
+   std::vector<uint8_t> X;
+
+   for(auto i = shares.begin(); i != shares.end(); ++i)
+      {
+      if(i->first >= N)
+         throw std::logic_error("Invalid share id detected during decode");
+
+      ids.push_back(i->first);
+      ptrs.push_back(i->second);
+      X.push_back(i->first ? GF_EXP[i->first] : 0);
+      }
+
+   const size_t n = ids.size();
+   const size_t r = n - K; // number of syndromes
+
+   /*
+   S_m = sum v_i X_i^m y_i is zero for every codeword y and m < r,
+   where v_i = 1 / prod_{j != i} (X_i - X_j). So the syndromes depend
+   only on the errors, S_m = sum Y_l X_l^m over the corrupted shares
+   (taking 0^0 = 1).
+   */
+   std::vector<uint8_t> checks(r * n);
+   for(size_t i = 0; i != n; ++i)
+      {
+      uint8_t v = 1;
+      for(size_t j = 0; j != n; ++j)
+         if(j != i)
+            v = GF_MUL_TABLE[v][X[i] ^ X[j]];
+
+      v = GF_INVERSE[v];
+      for(size_t m = 0; m != r; ++m)
+         {
+         checks[m*n + i] = v;
+         v = GF_MUL_TABLE[v][X[i]];
+         }
+      }
+
+   std::vector<bool> bad(n);
+   size_t bad_count = 0;
+
+   /*
+   The locator of the shares already known to be bad. Most positions
+   are either clean or corrupted only in those shares, which is
+   checked for without running Berlekamp-Massey.
+   */
+   std::vector<uint8_t> locator(1, 1);
+   std::vector<uint8_t> conn;
+
+   const size_t tile_size = 1024;
+   std::vector<uint8_t> tile(r * tile_size);
+   std::vector<uint8_t> S(r);
+
+   for(size_t done = 0; r && done != share_size; )
+      {
+      const size_t len = std::min(tile_size, share_size - done);
+
+      std::fill(tile.begin(), tile.end(), 0);
+      for(size_t m = 0; m != r; ++m)
+         for(size_t i = 0; i != n; ++i)
+            addmul(&tile[m*tile_size], ptrs[i] + done, checks[m*n + i], len);
+
+      for(size_t b = 0; b != len; ++b)
+         {
+         for(size_t m = 0; m != r; ++m)
+            S[m] = tile[m*tile_size + b];
+
+         if(satisfies_recurrence(locator, &S[0], r))
+            continue;
+
+         const size_t L = berlekamp_massey(&S[0], r, conn);
+
+         /*
+         The locator has a root at 1/X_i for each corrupted share. An
+         error in share 0, where X_0 = 0, instead shows as a locator
+         of degree less than L.
+         */
+         size_t roots = 0;
+         for(size_t i = 0; i != n; ++i)
+            {
+            if(X[i] ? poly_eval(conn, GF_INVERSE[X[i]]) != 0 : conn[L] != 0)
+               continue;
+
+            ++roots;
+            if(!bad[i])
+               {
+               bad[i] = true;
+               ++bad_count;
+               }
+            }
+
+         if(2*L > r || roots != L || 2*bad_count > r)
+            throw std::logic_error("Could not decode, too many corrupted shares");
+
+         locator.assign(1, 1);
+         for(size_t i = 0; i != n; ++i)
+            {
+            if(!bad[i])
+               continue;
+
+            // multiply by (1 + X_i z), keeping the length L
+            locator.push_back(0);
+            for(size_t j = locator.size() - 1; j != 0; --j)
+               locator[j] ^= GF_MUL_TABLE[locator[j-1]][X[i]];
+            }
+         }
+
+      done += len;
+      }
+
+   std::map<size_t, const uint8_t*> good;
+   std::vector<size_t> corrupted;
+
+   for(size_t i = 0; i != n; ++i)
+      {
+      if(bad[i])
+         corrupted.push_back(ids[i]);
+      else
+         good[ids[i]] = ptrs[i];
+      }
+
+   decode(good, share_size, output);
+
+   return corrupted;
+   }
+
+/*
+* Decode many stripes with the same erasure pattern
+*/
+void fec_code::decode_batch(
+   const std::vector<size_t>& share_ids,
+   const std::vector<const uint8_t*>& shares,
+   size_t share_size,
+   std::function<void (size_t, size_t, size_t, const uint8_t[], size_t)> output,
+   size_t threads) const
+   {
+   const size_t width = share_ids.size();
+
+   if(width == 0 || shares.size() % width != 0)
+      throw std::invalid_argument("decode_batch: bad number of shares");
+
+   const size_t stripes = shares.size() / width;
+
+   if(stripes == 0)
+      return;
+
+   /*
+   Set up the decoding matrix once, using the first stripe, then note
+   which column of the shares array each row of it refers to
+   */
+   std::map<size_t, const uint8_t*> first;
+   std::map<size_t, size_t> column_of;
+   for(size_t i = 0; i != width; ++i)
+      {
+      first[share_ids[i]] = shares[i];
+      column_of[share_ids[i]] = i;
+      }
+
+   if(first.size() != width)
+      throw std::invalid_argument("decode_batch: duplicate share id");
+
+   std::vector<uint8_t> m_dec;
+   std::vector<size_t> indexes;
+   std::vector<const uint8_t*> sharesv;
+
+   decode_setup(first, m_dec, indexes, sharesv);
+
+   std::vector<size_t> columns(K);
+   for(size_t i = 0; i != K; ++i)
+      columns[i] = column_of[indexes[i]];
+
+   /*
+   The rows of the decoding matrix for the missing blocks become one
+   kernel, so the coefficient tables are expanded once for the batch
+   rather than on every addmul
+   */
+   std::vector<size_t> missing;
+   std::vector<uint8_t> rows;
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] >= K)
+         {
+         missing.push_back(i);
+         rows.insert(rows.end(), &m_dec[i*K], &m_dec[i*K + K]);
+         }
+      }
+
+   const fec_jit_kernel kernel(rows.data(), missing.size(), K);
+
+   auto decode_stripes = [&](size_t start, size_t step)
+      {
+      std::vector<uint8_t> buf(missing.size() * share_size);
+      std::vector<uint8_t*> out(missing.size());
+      for(size_t i = 0; i != missing.size(); ++i)
+         out[i] = &buf[i * share_size];
+
+      std::vector<const uint8_t*> in(K);
+
+      for(size_t stripe = start; stripe < stripes; stripe += step)
+         {
+         const uint8_t* const* stripe_shares = &shares[stripe * width];
+
+         for(size_t i = 0; i != K; ++i)
+            {
+            in[i] = stripe_shares[columns[i]];
+            if(indexes[i] < K)
+               output(stripe, i, K, in[i], share_size);
+            }
+
+         if(missing.empty())
+            continue;
+
+         kernel.apply(in.data(), out.data(), share_size);
+
+         for(size_t i = 0; i != missing.size(); ++i)
+            output(stripe, missing[i], K, out[i], share_size);
+         }
+      };
+
+   threads = std::max<size_t>(1, std::min(threads, stripes));
+
+   if(threads == 1)
+      {
+      decode_stripes(0, 1);
+      return;
+      }
+
+   std::vector<std::thread> workers;
+   std::vector<std::exception_ptr> errors(threads);
+
+   for(size_t t = 0; t != threads; ++t)
+      {
+      workers.push_back(std::thread([&, t]()
+         {
+         try
+            {
+            decode_stripes(t, threads);
+            }
+         catch(...)
+            {
+            errors[t] = std::current_exception();
+            }
+         }));
+      }
+
+   for(size_t t = 0; t != threads; ++t)
+      workers[t].join();
+
+   for(size_t t = 0; t != threads; ++t)
+      if(errors[t])
+         std::rethrow_exception(errors[t]);
+   }
+
+/*
+* Decode a byte range of selected data blocks
+*/
+void fec_code::decode_range(
+   const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+   size_t offset, size_t length,
+   const std::vector<size_t>& blocks,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output) const
+   {
+   if(offset > share_size || length > share_size - offset)
+      throw std::invalid_argument("decode_range: range is outside the shares");
+
+   for(size_t i = 0; i != blocks.size(); ++i)
+      if(blocks[i] >= K)
+         throw std::invalid_argument("decode_range: invalid block id");
+
+   /*
+   If every requested block survived as a share, no decoding is needed
+   */
+   bool all_present = true;
+   for(size_t i = 0; i != blocks.size(); ++i)
+      if(shares.find(blocks[i]) == shares.end())
+         all_present = false;
+
+   if(all_present)
+      {
+      for(size_t i = 0; i != blocks.size(); ++i)
+         output(blocks[i], K, shares.find(blocks[i])->second + offset, length);
+      return;
+      }
+
+   std::vector<uint8_t> m_dec;
+   std::vector<size_t> indexes;
+   std::vector<const uint8_t*> sharesv;
+
+   decode_setup(shares, m_dec, indexes, sharesv);
+
+   /*
+   The code is bytewise, so row i of the inverted matrix applied to
+   [offset, offset+length) of each share gives the same range of
+   block i. Only the rows for the requested blocks are computed.
+   */
+   std::vector<uint8_t> buf(length);
+
+   for(size_t b = 0; b != blocks.size(); ++b)
+      {
+      const size_t i = blocks[b];
+
+      if(indexes[i] < K)
+         {
+         output(i, K, sharesv[i] + offset, length);
+         continue;
+         }
+
+      std::fill(buf.begin(), buf.end(), 0);
+      for(size_t col = 0; col != K; ++col)
+         addmul(buf.data(), sharesv[col] + offset, m_dec[i*K + col], length);
+      output(i, K, buf.data(), length);
+      }
+   }
+
+/*
+* fec_encoder constructor
+*/
+fec_encoder::fec_encoder(
+   const fec_code& code_arg, size_t block_size_arg,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> out) :
+   code(code_arg),
+   block_size(block_size_arg),
+   output(out),
+   position(0),
+   parity((code.get_N() - code.get_K()) * block_size),
+   parity_ptrs(code.get_N() - code.get_K())
+   {
+   if(block_size == 0)
+      throw std::invalid_argument("fec_encoder: block_size must be non-zero");
+   }
+
+/*
+* Route input to its data block and fold it into the parity
+*/
+void fec_encoder::update(const uint8_t input[], size_t size)
+   {
+   const size_t K = code.get_K();
+   const size_t N = code.get_N();
+
+   while(size)
+      {
+      const size_t block = position / block_size;
+      const size_t offset = position % block_size;
+      const size_t take = std::min(size, block_size - offset);
+
+      output(block, N, input, take);
+
+      /*
+      Parity starts as zero, so adding a data block to it is the same
+      as updating it for a change from all zeros to the new contents
+      */
+      for(size_t i = 0; i != parity_ptrs.size(); ++i)
+         parity_ptrs[i] = &parity[i*block_size + offset];
+      code.update_parity(block, input, take, parity_ptrs.data());
+
+      input += take;
+      size -= take;
+      position += take;
+
+      if(position == K * block_size)
+         end_stripe();
+      }
+   }
+
+/*
+* Zero pad the final stripe
+*/
+void fec_encoder::finish()
+   {
+   if(position == 0)
+      return;
+
+   const size_t K = code.get_K();
+   const size_t N = code.get_N();
+
+   // zeros do not change the parity, so only the data shares need them
+   std::vector<uint8_t> zeros(block_size);
+
+   while(position != K * block_size)
+      {
+      const size_t block = position / block_size;
+      const size_t take = block_size - position % block_size;
+      output(block, N, zeros.data(), take);
+      position += take;
+      }
+
+   end_stripe();
+   }
+
+/*
+* Output the parity of a complete stripe and start the next one
+*/
+void fec_encoder::end_stripe()
+   {
+   const size_t K = code.get_K();
+   const size_t N = code.get_N();
+
+   for(size_t i = K; i != N; ++i)
+      output(i, N, &parity[(i-K)*block_size], block_size);
+
+   std::fill(parity.begin(), parity.end(), 0);
+   position = 0;
+   }
+
+/*
+* fec_decoder constructor
+*/
+fec_decoder::fec_decoder(
+   const fec_code& code_arg, size_t share_size_arg,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> out) :
+   code(code_arg),
+   share_size(share_size_arg),
+   output(out),
+   matrix(code.K * code.K),
+   rows(code.K * share_size),
+   have(code.K),
+   emitted(code.K),
+   rank(0)
+   {
+   }
+
+/*
+* Fold a newly arrived share into the system
+*/
+bool fec_decoder::add_share(size_t share_id, const uint8_t share[])
+   {
+   const size_t K = code.K;
+
+   if(share_id >= code.N)
+      throw std::invalid_argument("fec_decoder: invalid share id");
+
+   if(rank == K)
+      return false;
+
+   std::vector<uint8_t> coef(&code.enc_matrix[share_id*K],
+                             &code.enc_matrix[share_id*K] + K);
+
+   const size_t pivot = add_equation(&matrix[0], &rows[0], have,
+                                     K, share_size, &coef[0], share);
+
+   if(pivot == K)
+      return false;
+
+   ++rank;
+
+   /*
+   Output each block as soon as it is solved; adding a row only ever
+   changes rows that were not yet solved
+   */
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(have[i] && !emitted[i] && equation_solved(&matrix[0], K, i))
+         {
+         emitted[i] = true;
+         output(i, K, &rows[i*share_size], share_size);
+         }
+      }
+
+   return true;
+   }
+
+/*
+* fec_stream_decoder constructor
+*/
+fec_stream_decoder::fec_stream_decoder(
+   const fec_code& code_arg,
+   const std::vector<size_t>& share_ids,
+   size_t share_size_arg,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> out) :
+   code(code_arg),
+   share_size(share_size_arg),
+   output(out),
+   buffers(code.K * share_size),
+   position_of(code.N, code.K),
+   share_bufs(code.K),
+   scratch(share_size),
+   covered(code.K),
+   pending(code.K),
+   decoded(0)
+   {
+   const size_t K = code.K;
+
+   if(share_ids.size() != K)
+      throw std::invalid_argument("fec_stream_decoder: need exactly K shares");
+
+   std::map<size_t, const uint8_t*> shares;
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(share_ids[i] >= code.N)
+         throw std::invalid_argument("fec_stream_decoder: invalid share id");
+      shares[share_ids[i]] = &buffers[i*share_size];
+      }
+
+   if(shares.size() != K)
+      throw std::invalid_argument("fec_stream_decoder: duplicate share id");
+
+   code.decode_setup(shares, m_dec, indexes, sharesv);
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      position_of[indexes[i]] = i;
+      share_bufs[i] = buffers.data() + (sharesv[i] - buffers.data());
+      }
+   }
+
+/*
+* Accept part of a share, and output whatever can now be decoded
+*/
+void fec_stream_decoder::add(size_t share_id, size_t offset,
+                             const uint8_t data[], size_t length)
+   {
+   const size_t K = code.K;
+
+   if(share_id >= code.N || position_of[share_id] == K)
+      throw std::invalid_argument("fec_stream_decoder: unexpected share id");
+
+   if(offset > share_size || length > share_size - offset)
+      throw std::invalid_argument("fec_stream_decoder: data past end of share");
+
+   if(length == 0)
+      return;
+
+   const size_t pos = position_of[share_id];
+
+   std::memcpy(share_bufs[pos] + offset, data, length);
+
+   const size_t was_covered = covered[pos];
+
+   size_t& end = pending[pos][offset];
+   end = std::max(end, offset + length);
+
+   while(!pending[pos].empty() && pending[pos].begin()->first <= covered[pos])
+      {
+      covered[pos] = std::max(covered[pos], pending[pos].begin()->second);
+      pending[pos].erase(pending[pos].begin());
+      }
+
+   // a data share can be passed on without waiting for the others
+   if(share_id < K && covered[pos] != was_covered)
+      output(share_id, K, sharesv[pos] + was_covered,
+             covered[pos] - was_covered);
+
+   const size_t window_end = *std::min_element(covered.begin(), covered.end());
+
+   if(window_end == decoded)
+      return;
+
+   const size_t window = window_end - decoded;
+   uint8_t* buf = scratch.data();
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(indexes[i] < K)
+         continue;
+
+      std::memset(buf, 0, window);
+      for(size_t col = 0; col != K; ++col)
+         addmul(buf, sharesv[col] + decoded, m_dec[i*K + col], window);
+      output(i, K, buf, window);
+      }
+
+   decoded = window_end;
+   }
+
+/*
+* fec_interleaver constructor
+*/
+fec_interleaver::fec_interleaver(
+   const fec_code& code_arg, size_t depth_arg, size_t block_size_arg,
+   std::function<void (uint64_t, size_t, size_t, const uint8_t[], size_t)> out) :
+   code(code_arg),
+   depth(depth_arg),
+   block_size(block_size_arg),
+   output(out),
+   ring(depth * code.K * block_size),
+   parity(depth * (code.N - code.K) * block_size),
+   held(0),
+   next_stripe(0)
+   {
+   if(depth == 0)
+      throw std::invalid_argument("fec_interleaver: depth must be positive");
+   }
+
+/*
+* Collect stripes in the ring. A whole group found in the input while
+* the ring is empty is sent straight from the input, without copying.
+*/
+void fec_interleaver::encode(const uint8_t input[], size_t size)
+   {
+   const size_t stripe_size = code.K * block_size;
+
+   if(size % stripe_size != 0)
+      throw std::invalid_argument("fec_interleaver: input must be whole stripes");
+
+   const size_t stripes = size / stripe_size;
+   std::vector<const uint8_t*> group(depth);
+
+   for(size_t s = 0; s != stripes; )
+      {
+      if(held == 0 && stripes - s >= depth)
+         {
+         for(size_t d = 0; d != depth; ++d)
+            group[d] = input + (s + d) * stripe_size;
+         send_group(group.data(), depth);
+         s += depth;
+         continue;
+         }
+
+      std::memcpy(&ring[held * stripe_size], input + s * stripe_size,
+                  stripe_size);
+      ++held;
+      ++s;
+
+      if(held == depth)
+         flush();
+      }
+   }
+
+/*
+* Send whatever stripes are in the ring
+*/
+void fec_interleaver::flush()
+   {
+   if(held == 0)
+      return;
+
+   std::vector<const uint8_t*> group(held);
+   for(size_t d = 0; d != held; ++d)
+      group[d] = &ring[d * code.K * block_size];
+
+   held = 0;
+   send_group(group.data(), group.size());
+   }
+
+/*
+* Encode a group of stripes, sending share i of each before share i+1
+* of any. Data shares are sent from where the stripes are.
+*/
+void fec_interleaver::send_group(const uint8_t* const stripes[], size_t count)
+   {
+   const size_t K = code.K, N = code.N;
+
+   std::fill(parity.begin(), parity.end(), 0);
+
+   for(size_t d = 0; d != count; ++d)
+      for(size_t i = K; i != N; ++i)
+         code.encode_parity(i, stripes[d], block_size,
+                            &parity[(d * (N - K) + i - K) * block_size]);
+
+   for(size_t i = 0; i != N; ++i)
+      for(size_t d = 0; d != count; ++d)
+         {
+         const uint8_t* share = (i < K) ?
+            stripes[d] + i * block_size :
+            &parity[(d * (N - K) + i - K) * block_size];
+
+         output(next_stripe + d, i, N, share, block_size);
+         }
+
+   next_stripe += count;
+   }
+
+/*
+* fec_deinterleaver constructor
+*/
+fec_deinterleaver::fec_deinterleaver(
+   const fec_code& code_arg, size_t depth, size_t share_size_arg,
+   std::function<void (uint64_t, size_t, size_t, const uint8_t[], size_t)> out) :
+   code(code_arg),
+   share_size(share_size_arg),
+   output(out),
+   ring(depth),
+   lost(0)
+   {
+   if(depth == 0)
+      throw std::invalid_argument("fec_deinterleaver: depth must be positive");
+
+   for(size_t i = 0; i != ring.size(); ++i)
+      {
+      ring[i].stripe = 0;
+      ring[i].used = ring[i].done = false;
+      }
+   }
+
+/*
+* Note a share in its stripe's slot, decoding once K have arrived
+*/
+bool fec_deinterleaver::add(uint64_t stripe, size_t share_id,
+                            const uint8_t share[])
+   {
+   if(share_id >= code.get_N())
+      throw std::invalid_argument("fec_deinterleaver: invalid share id");
+
+   slot& s = ring[stripe % ring.size()];
+
+   if(s.used && s.stripe > stripe)
+      return false;
+
+   if(!s.used || s.stripe < stripe)
+      {
+      // count the stripes for this slot which never had a share arrive
+      const uint64_t expected = s.used ? s.stripe + ring.size() :
+                                         stripe % ring.size();
+      lost += (stripe - expected) / ring.size();
+
+      if(s.used && !s.done)
+         ++lost;
+
+      s.stripe = stripe;
+      s.used = true;
+      s.done = false;
+      s.shares.clear();
+      }
+
+   if(s.done || s.shares.count(share_id))
+      return false;
+
+   s.shares[share_id] = share;
+
+   if(s.shares.size() == code.get_K())
+      {
+      s.done = true;
+      code.decode(s.shares, share_size,
+                  [&](size_t i, size_t K, const uint8_t buf[], size_t len)
+                     { output(stripe, i, K, buf, len); });
+      }
+
+   return true;
+   }
+
+/*
+* Give up on the stripes still waiting for shares
+*/
+void fec_deinterleaver::flush()
+   {
+   for(size_t i = 0; i != ring.size(); ++i)
+      {
+      if(ring[i].used && !ring[i].done)
+         {
+         ++lost;
+         ring[i].done = true;
+         }
+      }
+   }
+
+/*
+* fec_redundancy_controller constructor
+*/
+fec_redundancy_controller::fec_redundancy_controller(size_t K_arg,
+                                                     size_t max_N,
+                                                     double target_arg,
+                                                     double smoothing_arg) :
+   K(K_arg),
+   N(max_N),
+   target(target_arg),
+   smoothing(smoothing_arg),
+   loss(0),
+   burst(1),
+   have_report(false),
+   full(K_arg, max_N),
+   codes(max_N - K_arg + 1)
+   {
+   if(smoothing <= 0 || smoothing > 1)
+      throw std::invalid_argument("fec_redundancy_controller: bad smoothing");
+   }
+
+/*
+* Fold in a receiver report; until the first one arrives, send as much
+* redundancy as allowed
+*/
+void fec_redundancy_controller::report(double loss_rate, double burst_length)
+   {
+   loss_rate = std::min(std::max(loss_rate, 0.0), 1.0);
+   burst_length = std::max(burst_length, 1.0);
+
+   if(!have_report)
+      {
+      loss = loss_rate;
+      burst = burst_length;
+      have_report = true;
+      }
+   else
+      {
+      loss += smoothing * (loss_rate - loss);
+      burst += smoothing * (burst_length - burst);
+      }
+
+   N = choose_N();
+   }
+
+/*
+* Find the smallest N where more than N-K of N packets are lost with
+* probability at most target, by running the loss distribution of the
+* Gilbert channel forward one packet at a time
+*/
+size_t fec_redundancy_controller::choose_N() const
+   {
+   const size_t max_N = full.get_N();
+
+   if(loss >= 1)
+      return max_N;
+
+   // chance of leaving the bad state, and of entering it
+   const double r = 1 / burst;
+   const double q = std::min(loss * r / (1 - loss), 1.0);
+
+   // probability of having lost l packets and being in each state
+   std::vector<double> good(max_N + 1), bad(max_N + 1);
+   good[0] = 1 - loss;
+   bad[0] = loss;
+
+   for(size_t n = 1; n <= max_N; ++n)
+      {
+      for(size_t l = n; l != 0; --l)
+         {
+         const double g = good[l], b = bad[l-1];
+         good[l] = g * (1 - q) + b * r;
+         bad[l] = g * q + b * (1 - r);
+         }
+
+      const double g = good[0];
+      good[0] = g * (1 - q);
+      bad[0] = g * q;
+
+      if(n < K)
+         continue;
+
+      double failure = 0;
+      for(size_t l = n - K + 1; l <= n; ++l)
+         failure += good[l] + bad[l];
+
+      if(failure <= target)
+         return n;
+      }
+
+   return max_N;
+   }
+
+/*
+* Each code is cut down from the full one on first use, which copies
+* its matrix rows rather than computing them
+*/
+std::shared_ptr<const fec_code> fec_redundancy_controller::code()
+   {
+   std::shared_ptr<const fec_code>& code = codes[N - K];
+
+   if(!code)
+      code = std::make_shared<const fec_code>(full.extended(N));
+
+   return code;
+   }
+
+/*
+* fec_jit_kernel constructor
+*/
+fec_jit_kernel::fec_jit_kernel(const uint8_t matrix_arg[],
+                               size_t rows_arg, size_t cols_arg) :
+   rows(rows_arg),
+   cols(cols_arg),
+   matrix(matrix_arg, matrix_arg + rows_arg * cols_arg)
+   {
+   init_fec();
+
+   if(rows == 0 || cols == 0)
+      return;
+
+#if defined(FECPP_IS_X86)
+   if(!has_ssse3())
+      return;
+#endif
+
+   jit_kernel_fn fn = jit_matrix_kernel(&matrix[0], rows, cols, GF_MUL_TABLE);
+
+   if(fn)
+      kernel = std::shared_ptr<void>(reinterpret_cast<void*>(fn),
+                                     [](void* p)
+                                        {
+                                        jit_release(reinterpret_cast<jit_kernel_fn>(p));
+                                        });
+   }
+
+fec_jit_kernel fec_jit_kernel::encoder(const fec_code& code)
+   {
+   return fec_jit_kernel(&code.enc_matrix[code.K * code.K],
+                         code.N - code.K, code.K);
+   }
+
+fec_jit_kernel fec_jit_kernel::decoder(const fec_code& code,
+                                       const std::vector<size_t>& share_ids)
+   {
+   const size_t K = code.K;
+
+   if(share_ids.size() != K)
+      throw std::invalid_argument("fec_jit_kernel: need K share ids");
+
+   std::vector<uint8_t> m(K * K);
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(share_ids[i] >= code.N)
+         throw std::invalid_argument("fec_jit_kernel: invalid share id");
+      std::memcpy(&m[i*K], &code.enc_matrix[share_ids[i]*K], K);
+      }
+
+   invert_matrix(&m[0], K);
+
+   return fec_jit_kernel(&m[0], K, K);
+   }
+
+/*
+* Run the generated code over the whole vectors, and the portable code
+* over whatever is left
+*/
+void fec_jit_kernel::apply(const uint8_t* const in[], uint8_t* const out[],
+                           size_t size) const
+   {
+   size_t done = 0;
+
+   if(kernel && size >= 16)
+      {
+      done = size - size % 16;
+      reinterpret_cast<jit_kernel_fn>(kernel.get())(in, out, done);
+      }
+
+   if(done == size)
+      return;
+
+   for(size_t i = 0; i != rows; ++i)
+      {
+      std::memset(out[i] + done, 0, size - done);
+      for(size_t j = 0; j != cols; ++j)
+         addmul(out[i] + done, in[j] + done, matrix[i*cols + j], size - done);
+      }
+   }
+
+/*
+* fec_window_encoder constructor
+*/
+fec_window_encoder::fec_window_encoder(size_t window_arg,
+                                       size_t packet_size_arg) :
+   window(window_arg),
+   packet_size(packet_size_arg),
+   packets(window * packet_size),
+   next_seq(0),
+   next_repair(0)
+   {
+   if(window == 0)
+      throw std::invalid_argument("fec_window_encoder: window must be positive");
+
+   init_fec();
+   }
+
+/*
+* Add a source packet to the window
+*/
+uint64_t fec_window_encoder::add_source(const uint8_t packet[])
+   {
+   std::memcpy(&packets[(next_seq % window) * packet_size], packet, packet_size);
+   return next_seq++;
+   }
+
+/*
+* Combine the packets in the window into a repair packet
+*/
+uint64_t fec_window_encoder::repair(uint8_t out[], uint64_t& first,
+                                    size_t& count)
+   {
+   if(next_seq == 0)
+      throw std::logic_error("fec_window_encoder: no source packets yet");
+
+   first = (next_seq > window) ? next_seq - window : 0;
+   count = next_seq - first;
+
+   const uint64_t repair_id = next_repair++;
+
+   std::memset(out, 0, packet_size);
+   for(uint64_t seq = first; seq != next_seq; ++seq)
+      addmul(out, &packets[(seq % window) * packet_size],
+             window_coefficient(repair_id, seq), packet_size);
+
+   return repair_id;
+   }
+
+/*
+* fec_window_decoder constructor
+*/
+fec_window_decoder::fec_window_decoder(
+   size_t window, size_t packet_size_arg,
+   std::function<void (uint64_t, const uint8_t[], size_t)> out) :
+   cols(2 * window),
+   packet_size(packet_size_arg),
+   output(out),
+   matrix(cols * cols),
+   rows(cols * packet_size),
+   have(cols),
+   emitted(cols),
+   col_seq(cols),
+   horizon(0)
+   {
+   if(window == 0)
+      throw std::invalid_argument("fec_window_decoder: window must be positive");
+
+   init_fec();
+
+   for(size_t c = 0; c != cols; ++c)
+      col_seq[c] = c;
+   }
+
+/*
+* Move the window forward so it ends at sequence number end. Column
+* seq % cols is reused for seq, so the packet it held before is given
+* up on: its row, and any row which still depends on it, is dropped.
+*/
+void fec_window_decoder::advance(uint64_t end)
+   {
+   if(end <= horizon)
+      return;
+
+   for(uint64_t seq = std::max(horizon, end > cols ? end - cols : 0);
+       seq != end; ++seq)
+      {
+      const size_t c = seq % cols;
+
+      if(seq >= cols)
+         {
+         for(size_t r = 0; r != cols; ++r)
+            if(have[r] && (r == c || matrix[r*cols + c] != 0))
+               have[r] = false;
+         }
+
+      col_seq[c] = seq;
+      emitted[c] = false;
+      }
+
+   horizon = end;
+   }
+
+/*
+* Add an equation, and output any packets it lets us solve
+*/
+bool fec_window_decoder::add(std::vector<uint8_t>& coef,
+                             const uint8_t packet[])
+   {
+   const size_t pivot = add_equation(&matrix[0], &rows[0], have,
+                                     cols, packet_size, &coef[0], packet);
+
+   if(pivot == cols)
+      return false;
+
+   for(size_t c = 0; c != cols; ++c)
+      {
+      if(have[c] && !emitted[c] && equation_solved(&matrix[0], cols, c))
+         {
+         emitted[c] = true;
+         output(col_seq[c], &rows[c*packet_size], packet_size);
+         }
+      }
+
+   return true;
+   }
+
+/*
+* Accept a source packet
+*/
+bool fec_window_decoder::add_source(uint64_t seq, const uint8_t packet[])
+   {
+   advance(seq + 1);
+
+   const size_t c = seq % cols;
+
+   if(col_seq[c] != seq || emitted[c])
+      return false; // too old, or already output
+
+   std::vector<uint8_t> coef(cols);
+   coef[c] = 1;
+
+   return add(coef, packet);
+   }
+
+/*
+* Accept a repair packet
+*/
+bool fec_window_decoder::add_repair(uint64_t repair_id, uint64_t first,
+                                    size_t count, const uint8_t packet[])
+   {
+   if(count == 0 || count > cols / 2)
+      throw std::invalid_argument("fec_window_decoder: invalid repair span");
+
+   advance(first + count);
+
+   if(col_seq[first % cols] != first)
+      return false; // covers packets no longer in the window
+
+   /*
+   Packets already output still have their solved rows, so they are
+   eliminated from the new equation like any other
+   */
+   std::vector<uint8_t> coef(cols);
+   for(uint64_t seq = first; seq != first + count; ++seq)
+      coef[seq % cols] = window_coefficient(repair_id, seq);
+
+   return add(coef, packet);
+   }
+
+/*
+* rlnc_encoder constructor
+*/
+rlnc_encoder::rlnc_encoder(size_t K_arg, size_t packet_size_arg,
+                           const uint8_t input_arg[], uint64_t seed) :
+   K(K_arg),
+   packet_size(packet_size_arg),
+   input(input_arg),
+   rng_state(seed ? seed : 1)
+   {
+   if(K == 0)
+      throw std::invalid_argument("rlnc_encoder: K must be positive");
+
+   init_fec();
+   }
+
+/*
+* Produce a coded packet
+*/
+void rlnc_encoder::next(uint8_t out[])
+   {
+   random_coefficients(rng_state, out, K);
+
+   uint8_t* payload = out + K;
+   std::memset(payload, 0, packet_size);
+   for(size_t j = 0; j != K; ++j)
+      addmul(payload, input + j*packet_size, out[j], packet_size);
+   }
+
+/*
+* rlnc_decoder constructor
+*/
+rlnc_decoder::rlnc_decoder(
+   size_t K_arg, size_t packet_size_arg,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> out,
+   uint64_t seed) :
+   K(K_arg),
+   packet_size(packet_size_arg),
+   output(out),
+   matrix(K * K),
+   rows(K * packet_size),
+   have(K),
+   emitted(K),
+   received(0),
+   rng_state(seed ? seed : 1)
+   {
+   if(K == 0)
+      throw std::invalid_argument("rlnc_decoder: K must be positive");
+
+   init_fec();
+   }
+
+/*
+* Fold a coded packet into the system
+*/
+bool rlnc_decoder::add(const uint8_t coded[])
+   {
+   if(received == K)
+      return false;
+
+   std::vector<uint8_t> coef(coded, coded + K);
+
+   const size_t pivot = add_equation(&matrix[0], &rows[0], have,
+                                     K, packet_size, &coef[0], coded + K);
+
+   if(pivot == K)
+      return false;
+
+   ++received;
+
+   for(size_t i = 0; i != K; ++i)
+      {
+      if(have[i] && !emitted[i] && equation_solved(&matrix[0], K, i))
+         {
+         emitted[i] = true;
+         if(output)
+            output(i, K, &rows[i*packet_size], packet_size);
+         }
+      }
+
+   return true;
+   }
+
+/*
+* Combine the received packets into a new coded packet. The reduced
+* rows span the same space as the packets received, so a random
+* combination of them is as good as one of the originals.
+*/
+bool rlnc_decoder::recode(uint8_t out[])
+   {
+   if(received == 0)
+      return false;
+
+   std::vector<uint8_t> mix(K);
+   bool useful = false;
+
+   while(!useful)
+      {
+      random_coefficients(rng_state, &mix[0], K);
+
+      for(size_t r = 0; r != K; ++r)
+         useful = useful || (have[r] && mix[r] != 0);
+      }
+
+   std::memset(out, 0, K + packet_size);
+   for(size_t r = 0; r != K; ++r)
+      {
+      if(!have[r] || mix[r] == 0)
+         continue;
+
+      addmul(out, &matrix[r*K], mix[r], K);
+      addmul(out + K, &rows[r*packet_size], mix[r], packet_size);
+      }
+
+   return true;
+   }
+
+/*
+* fec_share_generator constructor
+*/
+fec_share_generator::fec_share_generator(const fec_code& code_arg,
+                                         const uint8_t input_arg[],
+                                         size_t size) :
+   code(code_arg),
+   input(input_arg),
+   block_size(size / code.K),
+   next_id(0)
+   {
+   if(size % code.K != 0)
+      throw std::invalid_argument("fec_share_generator: input must be multiple of K bytes");
+   }
+
+/*
+* Produce the next share in order
+*/
+bool fec_share_generator::next(size_t& share_id,
+                               const uint8_t*& share_data,
+                               size_t& share_len)
+   {
+   if(next_id == code.N)
+      return false;
+
+   share_id = next_id++;
+   share_data = share(share_id);
+   share_len = block_size;
+   return true;
+   }
+
+/*
+* Compute a share on demand
+*/
+const uint8_t* fec_share_generator::share(size_t share_id)
+   {
+   if(share_id >= code.N)
+      throw std::invalid_argument("fec_share_generator: invalid share id");
+
+   if(share_id < code.K)
+      return input + share_id*block_size;
+
+   buf.assign(block_size, 0);
+   code.encode_parity(share_id, input, block_size, buf.data());
+   return buf.data();
+   }
+
+namespace {
+
+std::mutex registry_mutex;
+std::map<std::pair<size_t, size_t>, std::shared_ptr<const fec_code> > registry;
+
+}
+
+/*
+* Return the shared instance of a code, creating it if needed
+*/
+std::shared_ptr<const fec_code> shared_fec_code(size_t K, size_t N)
+   {
+   const std::pair<size_t, size_t> key(K, N);
+
+      {
+      std::lock_guard<std::mutex> lock(registry_mutex);
+
+      auto i = registry.find(key);
+      if(i != registry.end())
+         return i->second;
+      }
+
+   /*
+   Build without holding the lock, so constructing a large code does
+   not stall lookups of other codes. If another thread stored one in
+   the meantime, that one is kept and returned instead.
+   */
+   std::shared_ptr<const fec_code> code = std::make_shared<const fec_code>(K, N);
+
+   std::lock_guard<std::mutex> lock(registry_mutex);
+
+   return registry.emplace(key, code).first->second;
+   }
+
+/*
+* Add a code to the shared instances
+*/
+void register_fec_code(std::shared_ptr<const fec_code> code)
+   {
+   if(!code)
+      throw std::invalid_argument("register_fec_code: null code");
+
+   std::lock_guard<std::mutex> lock(registry_mutex);
+
+   registry.emplace(std::make_pair(code->get_K(), code->get_N()), code);
+   }
+
+/*
+* Compute a CRC32C
+*/
+uint32_t crc32c(uint32_t crc, const uint8_t buf[], size_t len)
+   {
+   return ~crc32c_update(~crc, buf, len);
+   }
+
+/*
+* Check for an all zero buffer
+*/
+bool is_zero(const uint8_t buf[], size_t len)
+   {
+#if defined(FECPP_IS_X86)
+   if(len >= 16 && has_sse2())
+      {
+      if(!is_zero_sse2(buf, len))
+         return false;
+
+      buf += len - len % 16;
+      len %= 16;
+      }
+#endif
+
+   uint8_t acc = 0;
+   for(size_t i = 0; i != len; ++i)
+      acc |= buf[i];
+   return acc == 0;
+   }
+
+
+namespace gf {
+
+uint8_t mul(uint8_t a, uint8_t b)
+   {
+   if(a == 0 || b == 0)
+      return 0;
+   return GF_EXP[GF_LOG[a] + GF_LOG[b]];
+   }
+
+uint8_t div(uint8_t a, uint8_t b)
+   {
+   return mul(a, inverse(b));
+   }
+
+uint8_t inverse(uint8_t a)
+   {
+   if(a == 0)
+      throw std::invalid_argument("gf::inverse: zero has no inverse");
+   return GF_INVERSE[a];
+   }
+
+/*
+* In place, x*y = x + x*(y+1), and addmul only reads each byte of x
+* before writing the same byte of z
+*/
+void mul_region(uint8_t z[], const uint8_t x[], uint8_t y, size_t size)
+   {
+   if(y == 0)
+      std::memset(z, 0, size);
+   else if(z == x)
+      addmul(z, z, y ^ 1, size);
+   else
+      {
+      std::memcpy(z, x, size);
+      addmul(z, x, y ^ 1, size);
+      }
+   }
+
+void addmul_region(uint8_t z[], const uint8_t x[], uint8_t y, size_t size)
+   {
+   addmul(z, x, y, size);
+   }
+
+void dot_region(uint8_t z[], const uint8_t* const x[], const uint8_t y[],
+                size_t n, size_t size)
+   {
+   matrix_mul(y, 1, n, x, &z, size);
+   }
+
+/*
+* Work a tile at a time, so each output tile stays in cache while
+* all of the inputs are added to it
+*/
+void matrix_mul(const uint8_t matrix[], size_t rows, size_t cols,
+                const uint8_t* const in[], uint8_t* const out[], size_t size)
+   {
+   for(size_t done = 0; done < size; done += TILE_SIZE)
+      {
+      const size_t len = std::min(TILE_SIZE, size - done);
+
+      for(size_t i = 0; i != rows; ++i)
+         {
+         std::memset(out[i] + done, 0, len);
+         for(size_t j = 0; j != cols; ++j)
+            addmul(out[i] + done, in[j] + done, matrix[i*cols + j], len);
+         }
+      }
+   }
+
+}
+
 }
@@ -13,19 +13,28 @@
 #include <map>
 #include <vector>
 #include <functional>
+#include <memory>
 #include <cstdint>
 
 namespace fecpp {
 
 using std::uint8_t;
+using std::uint32_t;
+using std::uint64_t;
 using std::size_t;
 
 using byte = std::uint8_t;
 
-#if defined(__i386__) || defined(__x86_64__)
+/*
+* Define FECPP_GENERIC_ONLY to build only the portable code, for
+* instance to test it on x86
+*/
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(FECPP_GENERIC_ONLY)
   #define FECPP_IS_X86
 #endif
 
+class share_hasher;
+
 /**
 * Forward error correction code
 */
@@ -52,6 +61,112 @@ class fec_code
          std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
          const;
 
+      /**
+      * Encode, also computing the CRC32C of each share. The CRCs are
+      * computed as the shares are produced, so no extra pass over the
+      * data is needed.
+      * @param input the data to FEC
+      * @param size the length in bytes of input
+      * @param out the output callback, called with the share id, N,
+      *        the share contents and length, and the CRC32C of the share
+      */
+      void encode_crc32c(
+         const uint8_t input[], size_t size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t,
+                             uint32_t)> out) const;
+
+      /**
+      * Encode, also feeding each share to a share_hasher. All N
+      * shares are hashed together, a tile at a time, as they are
+      * produced.
+      * @param input the data to FEC
+      * @param size the length in bytes of input
+      * @param hasher a hasher for N shares; calling this for each
+      *        stripe in turn hashes the concatenation of the stripes
+      * @param out the output callback
+      */
+      void encode_hashed(
+         const uint8_t input[], size_t size, share_hasher& hasher,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * @return the encoding matrix in a form that deserialize accepts,
+      *         with a header and a CRC32C
+      */
+      std::vector<uint8_t> serialize() const;
+
+      /**
+      * Create a code from the output of serialize, without
+      * recomputing the encoding matrix. Throws std::invalid_argument
+      * if the header, length or checksum is wrong.
+      * @param data the serialized code
+      * @param len the length in bytes of data
+      */
+      static fec_code deserialize(const uint8_t data[], size_t len);
+
+      /**
+      * Check that the parity shares are consistent with the data.
+      * Each parity share is recomputed and compared in a single pass
+      * without being stored.
+      * @param shares array of N pointers to the shares; parity shares
+      *        which are null are not checked
+      * @param share_size size in bytes of each share
+      * @return map from the id of each parity share that does not
+      *         match to the offset of its first incorrect byte
+      */
+      std::map<size_t, size_t> verify(const uint8_t* const shares[],
+                                      size_t share_size) const;
+
+      /**
+      * Encode only some of the shares
+      * @param share_ids the ids of the shares to output
+      * @param input the data to FEC
+      * @param size the length in bytes of input
+      * @param out the output callback
+      */
+      void encode_shares(
+         const std::vector<size_t>& share_ids,
+         const uint8_t input[], size_t size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Encode K packets of varying lengths, without copying them into
+      * a padded buffer. The data shares are the packets themselves;
+      * each parity share is 2 + (the longest packet's length) bytes,
+      * and also encodes the packet lengths so decode_packets can
+      * restore them.
+      * @param packets array of K pointers to the packets
+      * @param lengths array of K packet lengths, each at most 65535
+      * @param out the output callback
+      */
+      void encode_packets(
+         const uint8_t* const packets[], const size_t lengths[],
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Decode packets encoded with encode_packets
+      * @param shares map of share id to the contents and length of
+      *        the share, as output by encode_packets
+      * @param out the output callback, called with each packet's
+      *        id and its original contents and length
+      */
+      void decode_packets(
+         const std::map<size_t, std::pair<const uint8_t*, size_t> >& shares,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Create a code for the same K with a different number of shares.
+      * Shares 0...min(N, new_N)-1 are identical for both codes, so
+      * this can be used to add redundancy to already encoded data, and
+      * only the encoding matrix rows past N need to be computed.
+      * @param new_N the number of shares the new code generates
+      */
+      fec_code extended(size_t new_N) const;
+
       /**
       * @param shares map of share id to share contents
       * @param share_size size in bytes of each share
@@ -62,11 +177,1020 @@ class fec_code
          std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
          const;
 
+      /**
+      * Decode, also computing the CRC32C of each output block as it
+      * is produced
+      * @param shares map of share id to share contents
+      * @param share_size size in bytes of each share
+      * @param out the output callback, called with the block id, K,
+      *        the block contents and length, and the CRC32C of the block
+      */
+      void decode_crc32c(
+         const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t,
+                             uint32_t)> out) const;
+
+      /**
+      * Decode, also feeding each of the given shares to a share_hasher
+      * so they can be checked against the hashes made when encoding
+      * @param shares map of share id to share contents
+      * @param share_size size in bytes of each share
+      * @param hasher a hasher for N shares; only the shares given are
+      *        hashed
+      * @param out the output callback
+      */
+      void decode_hashed(
+         const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+         share_hasher& hasher,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Decode from shares some of which may be silently corrupted.
+      * With n shares available, up to (n-K)/2 corrupted shares are
+      * located and left out of the decoding; more than that causes
+      * std::logic_error to be thrown, though it is not always detected.
+      * @param shares map of share id to share contents
+      * @param share_size size in bytes of each share
+      * @param out the output callback
+      * @return the ids of the shares found to be corrupted
+      */
+      std::vector<size_t> decode_correcting(
+         const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Decode many stripes that all have the same shares available.
+      * The decoding matrix is set up once, and turned into a
+      * fec_jit_kernel used for every stripe.
+      * @param share_ids ids of the shares present in every stripe
+      * @param shares for each stripe in turn, share_ids.size()
+      *        pointers to its shares, in the same order as share_ids
+      * @param share_size size in bytes of each share
+      * @param out the output callback, called with the stripe number,
+      *        the block id, K, and the block contents and length
+      * @param threads how many threads to decode with; with more than
+      *        one, out may be called from several threads at once
+      */
+      void decode_batch(
+         const std::vector<size_t>& share_ids,
+         const std::vector<const uint8_t*>& shares,
+         size_t share_size,
+         std::function<void (size_t, size_t, size_t,
+                             const uint8_t[], size_t)> out,
+         size_t threads = 1) const;
+
+      /**
+      * Decode only a byte range of the requested data blocks
+      * @param shares map of share id to share contents; only bytes
+      *        [offset, offset+length) of each share are read
+      * @param share_size size in bytes of each share; the range must
+      *        lie within it
+      * @param offset offset of the range within each share
+      * @param length length in bytes of the range
+      * @param blocks ids of the data blocks to recover
+      * @param out the output callback, called with each block's range
+      */
+      void decode_range(
+         const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+         size_t offset, size_t length,
+         const std::vector<size_t>& blocks,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Update parity shares in place after a data block changed
+      * @param block the id of the data block that changed
+      * @param old_data the previous contents of the changed range
+      * @param new_data the new contents of the changed range
+      * @param size the length in bytes of the changed range
+      * @param parity array of N-K pointers to the parity shares
+      *        K...N-1, each addressing the same range of its share
+      */
+      void update_parity(size_t block,
+                         const uint8_t old_data[], const uint8_t new_data[],
+                         size_t size, uint8_t* const parity[]) const;
+
+      /**
+      * Update parity shares in place given the change to a data block
+      * @param block the id of the data block that changed
+      * @param delta the old contents XOR the new contents
+      * @param size the length in bytes of delta
+      * @param parity array of N-K pointers to the parity shares
+      *        K...N-1, each addressing the same range of its share
+      */
+      void update_parity(size_t block, const uint8_t delta[],
+                         size_t size, uint8_t* const parity[]) const;
+
    private:
+      friend class fec_decoder;
+      friend class fec_stream_decoder;
+      friend class fec_share_generator;
+      friend class fec_product_code;
+      friend class fec_interleaver;
+      friend class fec_jit_kernel;
+
+      fec_code(size_t K, size_t N, const uint8_t parity_rows[]);
+
+      void build_parity_rows(size_t first);
+
+      void encode_parity(size_t i, const uint8_t input[],
+                         size_t block_size, uint8_t out[]) const;
+
+      void encode_parity(size_t i, const uint8_t input[],
+                         size_t block_size, const uint8_t nonzero[],
+                         uint8_t out[]) const;
+
+      void encode_parity(size_t i, const uint8_t* const blocks[],
+                         size_t block_size, uint8_t out[]) const;
+
+      void decode_setup(const std::map<size_t, const uint8_t*>& shares,
+                        std::vector<uint8_t>& m_dec,
+                        std::vector<size_t>& indexes,
+                        std::vector<const uint8_t*>& sharesv) const;
+
       size_t K, N;
       std::vector<uint8_t> enc_matrix;
    };
 
+/**
+* Product code
+*
+* Shares are laid out in a grid of N_rows by N_cols, where row_code
+* (with K = K_cols, N = N_cols) is applied along each row and col_code
+* (with K = K_rows, N = N_rows) along each column. The K_rows*K_cols
+* data blocks fill the top left corner. This allows far more than 256
+* shares, and a lost share can usually be rebuilt from just its row
+* or column, reading K_cols or K_rows shares instead of the whole
+* grid.
+*
+* Share ids number the grid row by row, so share r*N_cols + c is in
+* row r and column c, and data block r*K_cols + c is share
+* r*N_cols + c.
+*/
+class fec_product_code
+   {
+   public:
+      /**
+      * @param row_code the code applied along each row
+      * @param col_code the code applied along each column
+      */
+      fec_product_code(const fec_code& row_code, const fec_code& col_code);
+
+      size_t get_K() const { return row_code.get_K() * col_code.get_K(); }
+      size_t get_N() const { return row_code.get_N() * col_code.get_N(); }
+
+      /**
+      * @param input the data to FEC, get_K() blocks
+      * @param size the length in bytes of input
+      * @param out the output callback
+      */
+      void encode(
+         const uint8_t input[], size_t size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Decode by repeatedly repairing each row and column which has
+      * enough shares, until all data is recovered
+      * @param shares map of share id to share contents
+      * @param share_size size in bytes of each share
+      * @param out the output callback, called with each data block's
+      *        id, get_K(), and contents and length
+      */
+      void decode(
+         const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+      /**
+      * Rebuild a single lost share, from its row or column if that has
+      * enough shares, computing no other share; otherwise by decoding
+      * as much of the grid as necessary
+      * @param share_id the share to rebuild
+      * @param shares map of share id to share contents
+      * @param share_size size in bytes of each share
+      * @param out the output callback, called once with share_id
+      */
+      void repair(
+         size_t share_id,
+         const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const;
+
+   private:
+      class grid;
+
+      bool repair_line(grid& g, bool is_row, size_t line) const;
+      bool repair_cell(grid& g, bool is_row, size_t line, size_t pos) const;
+      bool solve(grid& g, const std::vector<size_t>& wanted) const;
+
+      fec_code row_code, col_code;
+   };
+
+/**
+* SHA-256 hashes of a set of shares, and the top hash over them
+*
+* Following format.txt, H_i = SHA-256(share i) and the top hash is
+* SHA-256(H_1 || ... || H_n). Since shares are of equal length and
+* produced together, they are hashed in parallel, with 8 lanes using
+* AVX2 or 4 using SSE2.
+*/
+class share_hasher
+   {
+   public:
+      /**
+      * @param n the number of shares
+      */
+      share_hasher(size_t n);
+
+      size_t get_n() const { return total.size(); }
+
+      /**
+      * Hash the next len bytes of each share
+      * @param shares array of n pointers; shares which are null
+      *        are left unchanged
+      * @param len the number of bytes to add to each share
+      */
+      void update(const uint8_t* const shares[], size_t len);
+
+      /**
+      * Hash the next len bytes of share i
+      */
+      void update(size_t i, const uint8_t data[], size_t len);
+
+      /**
+      * Complete the hashes; no more data can be added afterwards
+      */
+      void finish();
+
+      /**
+      * @return the SHA-256 hash of share i, after finish
+      */
+      std::vector<uint8_t> hash(size_t i) const;
+
+      /**
+      * @return the hash of the concatenation of all the share
+      *         hashes, after finish
+      */
+      std::vector<uint8_t> top_hash() const;
+
+   private:
+      std::vector<uint32_t> states;
+      std::vector<uint8_t> buffers;
+      std::vector<uint64_t> total;
+      std::vector<uint8_t> hashes;
+      bool finished;
+   };
+
+/**
+* Check if a buffer is entirely zero, for instance to find parts of
+* the output of encode that could be left as holes in a sparse file
+* @param buf the data
+* @param len the length in bytes of buf
+*/
+bool is_zero(const uint8_t buf[], size_t len);
+
+/**
+* Compute the SHA-256 hash of some data
+*/
+std::vector<uint8_t> sha256(const uint8_t data[], size_t len);
+
+/**
+* Arithmetic in GF(2^8), using the same field as the codes, for
+* building checksums, secret sharing or other codes. The region
+* functions use the fastest routines available on this machine.
+*/
+namespace gf {
+
+/**
+* @return a times b
+*/
+uint8_t mul(uint8_t a, uint8_t b);
+
+/**
+* @return a divided by b, which must not be zero
+*/
+uint8_t div(uint8_t a, uint8_t b);
+
+/**
+* @return the inverse of a, which must not be zero
+*/
+uint8_t inverse(uint8_t a);
+
+/**
+* Set z to x times y
+* @param z the output, which may be x itself but must not otherwise
+*        overlap it
+* @param x the input
+* @param y the multiplier
+* @param size the length in bytes of z and x
+*/
+void mul_region(uint8_t z[], const uint8_t x[], uint8_t y, size_t size);
+
+/**
+* Add x times y to z
+* @param z the output, which may be x itself but must not otherwise
+*        overlap it
+* @param x the input
+* @param y the multiplier
+* @param size the length in bytes of z and x
+*/
+void addmul_region(uint8_t z[], const uint8_t x[], uint8_t y, size_t size);
+
+/**
+* Set z to the sum of x[j] times y[j]
+* @param z the output, which must not overlap any input
+* @param x the n inputs
+* @param y the n multipliers
+* @param n the number of inputs
+* @param size the length in bytes of z and each input
+*/
+void dot_region(uint8_t z[], const uint8_t* const x[], const uint8_t y[],
+                size_t n, size_t size);
+
+/**
+* Multiply a matrix by a vector of regions
+* @param matrix rows*cols coefficients; output i is set to the sum of
+*        matrix[i*cols + j] times input j
+* @param rows the number of outputs
+* @param cols the number of inputs
+* @param in the cols inputs
+* @param out the rows outputs, which must not overlap any input
+* @param size the length in bytes of each input and output
+*/
+void matrix_mul(const uint8_t matrix[], size_t rows, size_t cols,
+                const uint8_t* const in[], uint8_t* const out[], size_t size);
+
+}
+
+/**
+* Sliding window FEC encoder
+*
+* Source packets, all of the same size, are numbered 0, 1, 2, ... as
+* they are added. Each repair packet is a random linear combination of
+* the last W source packets, so a loss can be recovered from repair
+* packets sent shortly after it, without waiting for the end of a
+* block. The coefficients are derived from the repair id and the
+* source sequence numbers, so only (repair id, first, count) needs to
+* be sent along with a repair packet.
+*/
+class fec_window_encoder
+   {
+   public:
+      /**
+      * @param window W, the number of recent source packets each
+      *        repair packet covers
+      * @param packet_size the size in bytes of each packet
+      */
+      fec_window_encoder(size_t window, size_t packet_size);
+
+      /**
+      * @param packet the next source packet, packet_size bytes
+      * @return the sequence number of the packet
+      */
+      uint64_t add_source(const uint8_t packet[]);
+
+      /**
+      * Compute a repair packet over the current window
+      * @param out receives the repair packet, packet_size bytes
+      * @param first set to the sequence number of the first source
+      *        packet covered
+      * @param count set to the number of source packets covered
+      * @return the repair id
+      */
+      uint64_t repair(uint8_t out[], uint64_t& first, size_t& count);
+
+   private:
+      size_t window, packet_size;
+      std::vector<uint8_t> packets;
+      uint64_t next_seq, next_repair;
+   };
+
+/**
+* Sliding window FEC decoder
+*
+* Source and repair packets are added as they arrive, and reduced by
+* Gauss-Jordan elimination against the packets received so far. Every
+* source packet is output once, either when it arrives or as soon as
+* it can be recovered, so packets may be output out of order. The
+* decoder keeps the last 2*W sequence numbers; older unrecovered
+* packets are given up on.
+*/
+class fec_window_decoder
+   {
+   public:
+      /**
+      * @param window W, as given to the encoder
+      * @param packet_size the size in bytes of each packet
+      * @param out the output callback, called with the sequence number
+      *        and contents of each source packet
+      */
+      fec_window_decoder(size_t window, size_t packet_size,
+                         std::function<void (uint64_t, const uint8_t[], size_t)> out);
+
+      /**
+      * @param seq the sequence number of the packet
+      * @param packet the contents of the packet
+      * @return true if the packet was used
+      */
+      bool add_source(uint64_t seq, const uint8_t packet[]);
+
+      /**
+      * @param repair_id the repair id returned by the encoder
+      * @param first the first source packet covered
+      * @param count the number of source packets covered
+      * @param packet the contents of the repair packet
+      * @return true if the packet was used, false if it was redundant
+      *         or too old
+      */
+      bool add_repair(uint64_t repair_id, uint64_t first, size_t count,
+                      const uint8_t packet[]);
+
+   private:
+      void advance(uint64_t end);
+      bool add(std::vector<uint8_t>& coef, const uint8_t packet[]);
+
+      size_t cols, packet_size;
+      std::function<void (uint64_t, const uint8_t[], size_t)> output;
+      std::vector<uint8_t> matrix, rows;
+      std::vector<bool> have, emitted;
+      std::vector<uint64_t> col_seq;
+      uint64_t horizon; // one past the highest sequence number seen
+   };
+
+/**
+* Random linear network coding encoder
+*
+* A generation of K source packets is sent as coded packets, each a
+* random linear combination of the K sources. A coded packet is the
+* K coefficients of its combination followed by packet_size bytes of
+* payload, so it can be decoded, or recoded by a relay, without any
+* other information.
+*/
+class rlnc_encoder
+   {
+   public:
+      /**
+      * @param K the number of source packets
+      * @param packet_size the size in bytes of each source packet
+      * @param input the K source packets, one after another; it must
+      *        outlive the encoder
+      * @param seed seed for the random coefficients
+      */
+      rlnc_encoder(size_t K, size_t packet_size, const uint8_t input[],
+                   uint64_t seed = 1);
+
+      /**
+      * @param out receives the next coded packet, coded_size() bytes
+      */
+      void next(uint8_t out[]);
+
+      size_t coded_size() const { return K + packet_size; }
+
+   private:
+      size_t K, packet_size;
+      const uint8_t* input;
+      uint64_t rng_state;
+   };
+
+/**
+* Random linear network coding decoder and recoder
+*
+* Coded packets are reduced by Gauss-Jordan elimination as they
+* arrive, and each source packet is output as soon as it is solved.
+* A relay can call recode at any time to produce a new coded packet,
+* a random combination of everything received so far. It does not
+* have to decode first, and the result is innovative for any receiver
+* that lacks part of what the relay has.
+*/
+class rlnc_decoder
+   {
+   public:
+      /**
+      * @param K the number of source packets
+      * @param packet_size the size in bytes of each source packet
+      * @param out the output callback, called with each source packet's
+      *        index, K, and contents and length; may be empty for a
+      *        relay which only recodes
+      * @param seed seed for the random coefficients used by recode
+      */
+      rlnc_decoder(size_t K, size_t packet_size,
+                   std::function<void (size_t, size_t, const uint8_t[], size_t)> out,
+                   uint64_t seed = 1);
+
+      /**
+      * @param coded a coded packet, coded_size() bytes
+      * @return true if the packet was innovative, false if it was a
+      *         combination of packets already received
+      */
+      bool add(const uint8_t coded[]);
+
+      /**
+      * @param out receives a recoded packet, coded_size() bytes
+      * @return false if nothing has been received yet
+      */
+      bool recode(uint8_t out[]);
+
+      size_t coded_size() const { return K + packet_size; }
+
+      /**
+      * @return the number of innovative packets received
+      */
+      size_t rank() const { return received; }
+
+      bool complete() const { return received == K; }
+
+   private:
+      size_t K, packet_size;
+      std::function<void (size_t, size_t, const uint8_t[], size_t)> output;
+      std::vector<uint8_t> matrix, rows;
+      std::vector<bool> have, emitted;
+      size_t received;
+      uint64_t rng_state;
+   };
+
+/**
+* Compute the CRC32C (Castagnoli) checksum of some data, using the
+* SSE4.2 crc32 instruction when the CPU has it
+* @param crc the CRC of the data preceding buf, or 0 to start
+* @param buf the data
+* @param len the length in bytes of buf
+* @return the CRC of the preceding data followed by buf
+*/
+uint32_t crc32c(uint32_t crc, const uint8_t buf[], size_t len);
+
+/**
+* Return a shared, immutable instance of fec_code(K, N), creating it
+* on first use. Codes can be expensive to construct for large K and N,
+* so this lets callers that need codes with varying parameters avoid
+* repeating the work. Safe to call from multiple threads.
+* @param K the number of shares needed for recovery
+* @param N the number of shares generated
+*/
+std::shared_ptr<const fec_code> shared_fec_code(size_t K, size_t N);
+
+/**
+* Make a code available through shared_fec_code, for instance one
+* created with fec_code::deserialize to avoid computing it at startup.
+* If a code with the same K and N is already shared (registered or
+* created by shared_fec_code), that one is kept.
+* @param code the code to register
+*/
+void register_fec_code(std::shared_ptr<const fec_code> code);
+
+/**
+* Streaming FEC encoder
+*
+* Input is accepted in pieces of any size and divided into stripes of
+* K blocks of block_size bytes each, the same way encode divides an
+* input of K*block_size bytes. Data is passed to the output callback
+* as soon as it arrives, while parity is accumulated incrementally and
+* output when its stripe is complete, so memory use is bounded by the
+* parity of a single stripe.
+*
+* A share may be output in several pieces; the pieces of each share
+* are always output in order, and every stripe adds exactly block_size
+* bytes to each of the N shares.
+*/
+class fec_encoder
+   {
+   public:
+      /**
+      * fec_encoder constructor
+      * @param code the code to use; it must outlive the encoder
+      * @param block_size the size in bytes of each share of a stripe
+      * @param out the output callback
+      */
+      fec_encoder(const fec_code& code, size_t block_size,
+                  std::function<void (size_t, size_t, const uint8_t[], size_t)> out);
+
+      /**
+      * @param input more data to FEC
+      * @param size the length in bytes of input
+      */
+      void update(const uint8_t input[], size_t size);
+
+      /**
+      * Pad any partially filled stripe with zeros and output it
+      */
+      void finish();
+
+   private:
+      void end_stripe();
+
+      const fec_code& code;
+      size_t block_size;
+      std::function<void (size_t, size_t, const uint8_t[], size_t)> output;
+      size_t position;
+      std::vector<uint8_t> parity;
+      std::vector<uint8_t*> parity_ptrs;
+   };
+
+/**
+* Pull based FEC encoder
+*
+* Instead of pushing every share through a callback, as encode does,
+* shares are computed one at a time when asked for. A consumer that
+* stops early does not pay for the parity shares it never requested.
+*/
+class fec_share_generator
+   {
+   public:
+      /**
+      * fec_share_generator constructor
+      * @param code the code to use; it must outlive the generator
+      * @param input the data to FEC; it must outlive the generator
+      * @param size the length in bytes of input, a multiple of K
+      */
+      fec_share_generator(const fec_code& code,
+                          const uint8_t input[], size_t size);
+
+      /**
+      * Produce the next share, in order of share id
+      * @param share_id set to the id of the share
+      * @param share set to the contents of the share, which remain
+      *        valid until the generator is next used
+      * @param share_len set to the length in bytes of the share
+      * @return false if all N shares have already been produced
+      */
+      bool next(size_t& share_id, const uint8_t*& share, size_t& share_len);
+
+      /**
+      * Produce a specific share
+      * @param share_id the id of the share to compute
+      * @return the share contents, valid until the generator is next used
+      */
+      const uint8_t* share(size_t share_id);
+
+      size_t share_size() const { return block_size; }
+
+   private:
+      const fec_code& code;
+      const uint8_t* input;
+      size_t block_size;
+      size_t next_id;
+      std::vector<uint8_t> buf;
+   };
+
+/**
+* Progressive FEC decoder
+*
+* Shares are added one at a time as they arrive, and each is reduced
+* against the shares already received (Gauss-Jordan elimination on
+* both the coefficients and the share contents), so most of the
+* decoding work overlaps with waiting for the remaining shares. Each
+* data block is output as soon as it can be determined, which for
+* data shares is immediately.
+*/
+class fec_decoder
+   {
+   public:
+      /**
+      * fec_decoder constructor
+      * @param code the code to use; it must outlive the decoder
+      * @param share_size the size in bytes of each share
+      * @param out the output callback
+      */
+      fec_decoder(const fec_code& code, size_t share_size,
+                  std::function<void (size_t, size_t, const uint8_t[], size_t)> out);
+
+      /**
+      * @param share_id the id of the share
+      * @param share the contents of the share, share_size bytes
+      * @return true if the share was used, false if it was redundant
+      */
+      bool add_share(size_t share_id, const uint8_t share[]);
+
+      /**
+      * @return true once all K data blocks have been output
+      */
+      bool complete() const { return rank == code.get_K(); }
+
+   private:
+      const fec_code& code;
+      size_t share_size;
+      std::function<void (size_t, size_t, const uint8_t[], size_t)> output;
+      std::vector<uint8_t> matrix, rows;
+      std::vector<bool> have, emitted;
+      size_t rank;
+   };
+
+/**
+* Decoder for shares that arrive as byte streams
+*
+* The K shares to decode from are chosen up front, and the matrix
+* inverted once. Each share's contents may then be supplied in pieces,
+* in any order. As soon as a range of bytes is present in all K
+* shares it is decoded and output, so recovered data can be passed on
+* before any share is complete. Data shares are passed through as
+* they arrive.
+*
+* As with fec_encoder, a block may be output in several pieces, which
+* are always output in order.
+*/
+class fec_stream_decoder
+   {
+   public:
+      /**
+      * fec_stream_decoder constructor
+      * @param code the code to use; it must outlive the decoder
+      * @param share_ids the ids of the K shares that will be supplied
+      * @param share_size the size in bytes of each share
+      * @param out the output callback
+      */
+      fec_stream_decoder(const fec_code& code,
+                         const std::vector<size_t>& share_ids,
+                         size_t share_size,
+                         std::function<void (size_t, size_t, const uint8_t[], size_t)> out);
+
+      /**
+      * @param share_id the id of the share this data belongs to
+      * @param offset the offset of data within the share
+      * @param data part of the contents of the share
+      * @param length the length in bytes of data
+      */
+      void add(size_t share_id, size_t offset,
+               const uint8_t data[], size_t length);
+
+      /**
+      * @return true once all K data blocks have been output completely
+      */
+      bool complete() const { return decoded == share_size; }
+
+   private:
+      const fec_code& code;
+      size_t share_size;
+      std::function<void (size_t, size_t, const uint8_t[], size_t)> output;
+
+      std::vector<uint8_t> m_dec;
+      std::vector<size_t> indexes;
+      std::vector<const uint8_t*> sharesv;
+
+      std::vector<uint8_t> buffers;
+      std::vector<size_t> position_of;
+
+      // where sharesv[i] is written, and space for decoded output
+      std::vector<uint8_t*> share_bufs;
+      std::vector<uint8_t> scratch;
+
+      // how many bytes at the start of each share are present
+      std::vector<size_t> covered;
+      // pieces that arrived ahead of the covered prefix, start -> end
+      std::vector<std::map<size_t, size_t> > pending;
+
+      size_t decoded;
+   };
+
+/**
+* Interleaved encoder for links with bursty loss
+*
+* Stripes are collected in a ring of depth stripes, across calls to
+* encode, and once it is full their shares are sent round robin across
+* the group: share 0 of each stripe, then share 1 of each, and so on.
+* A burst of B lost packets then costs each stripe only about B/depth
+* shares, so it is still decodable if that is no more than N-K.
+*/
+class fec_interleaver
+   {
+   public:
+      /**
+      * fec_interleaver constructor
+      * @param code the code to use; it must outlive the interleaver
+      * @param depth the number of stripes to interleave
+      * @param block_size the size in bytes of each share
+      * @param out the output callback, called with the stripe number,
+      *        then the share id, N, and contents and length
+      */
+      fec_interleaver(const fec_code& code, size_t depth, size_t block_size,
+         std::function<void (uint64_t, size_t, size_t, const uint8_t[], size_t)> out);
+
+      /**
+      * Add stripes, sending each group of depth stripes as it fills
+      * @param input the data to FEC, any number of stripes of K
+      *        blocks; stripes are numbered consecutively across calls
+      * @param size the length in bytes of input
+      */
+      void encode(const uint8_t input[], size_t size);
+
+      /**
+      * Send the stripes of a partly filled group, for instance at the
+      * end of the stream
+      */
+      void flush();
+
+   private:
+      void send_group(const uint8_t* const stripes[], size_t count);
+
+      const fec_code& code;
+      size_t depth, block_size;
+      std::function<void (uint64_t, size_t, size_t, const uint8_t[], size_t)> output;
+      std::vector<uint8_t> ring, parity;
+      size_t held;
+      uint64_t next_stripe;
+   };
+
+/**
+* Receiver for fec_interleaver
+*
+* The last depth stripes are held in a ring, each stripe being decoded
+* and output as soon as K of its shares have arrived. A share for a
+* newer stripe takes over the slot of the stripe depth before it, which
+* is given up on if it is still incomplete. Shares are not copied: the
+* ring holds pointers to the caller's buffers, and decoding reads from
+* them directly.
+*/
+class fec_deinterleaver
+   {
+   public:
+      /**
+      * fec_deinterleaver constructor
+      * @param code the code to use; it must outlive the deinterleaver
+      * @param depth the number of stripes interleaved by the sender
+      * @param share_size the size in bytes of each share
+      * @param out the output callback, called with the stripe number,
+      *        then the block number, K, and contents and length
+      */
+      fec_deinterleaver(const fec_code& code, size_t depth, size_t share_size,
+         std::function<void (uint64_t, size_t, size_t, const uint8_t[], size_t)> out);
+
+      /**
+      * @param stripe the stripe number the share belongs to
+      * @param share_id the id of the share
+      * @param share the contents of the share, share_size bytes. This
+      *        is not copied, and must stay valid until the stripe is
+      *        output, or given up on by flush or by the arrival of a
+      *        share for stripe + depth or later.
+      * @return true if the share was used, false if it was redundant
+      *         or its stripe is no longer held
+      */
+      bool add(uint64_t stripe, size_t share_id, const uint8_t share[]);
+
+      /**
+      * Give up on any stripes still incomplete
+      */
+      void flush();
+
+      /**
+      * @return the number of stripes given up on so far, including
+      *         any that no share arrived for
+      */
+      uint64_t stripes_lost() const { return lost; }
+
+   private:
+      struct slot
+         {
+         uint64_t stripe;
+         bool used, done;
+         std::map<size_t, const uint8_t*> shares;
+         };
+
+      const fec_code& code;
+      size_t share_size;
+      std::function<void (uint64_t, size_t, size_t, const uint8_t[], size_t)> output;
+      std::vector<slot> ring;
+      uint64_t lost;
+   };
+
+/**
+* Chooses how many parity shares to send for a fixed K, from loss
+* feedback reported by the receiver
+*
+* Loss is modelled as a two state Gilbert channel, where every packet
+* sent in the bad state is lost, with the loss rate and mean burst
+* length smoothed over reports. The controller picks the smallest N
+* for which the chance of losing more than N-K of N shares is below
+* the target. Codes for each N are derived from one code with max_N
+* shares, so they agree on every share id; a receiver can decode with
+* the max_N code whatever N the sender used.
+*/
+class fec_redundancy_controller
+   {
+   public:
+      /**
+      * fec_redundancy_controller constructor
+      * @param K the number of shares needed for recovery
+      * @param max_N the most shares that may be generated
+      * @param target the acceptable probability of a block being lost
+      * @param smoothing the weight of each report in the estimates
+      */
+      fec_redundancy_controller(size_t K, size_t max_N,
+                                double target = 1e-6,
+                                double smoothing = 0.125);
+
+      /**
+      * Update the loss estimates and the chosen N
+      * @param loss_rate the fraction of packets lost since the last report
+      * @param burst_length the mean length of runs of lost packets
+      */
+      void report(double loss_rate, double burst_length);
+
+      /**
+      * @return the number of shares to send for each block
+      */
+      size_t get_N() const { return N; }
+
+      /**
+      * @return the code to encode with, with get_N() shares
+      */
+      std::shared_ptr<const fec_code> code();
+
+      double loss_rate() const { return loss; }
+      double burst_length() const { return burst; }
+
+   private:
+      size_t choose_N() const;
+
+      size_t K, N;
+      double target, smoothing;
+      double loss, burst;
+      bool have_report;
+      fec_code full;
+      std::vector<std::shared_ptr<const fec_code> > codes;
+   };
+
+/**
+* A fixed matrix applied to a set of regions, such as the parity rows
+* of a code, or the inverse used to decode from a particular set of
+* shares. On x86-64, machine code is generated for the specific
+* matrix: the loops over inputs and outputs are unrolled, as many
+* coefficient tables as fit are kept in registers for the whole call,
+* and zero and one coefficients are handled without multiplying.
+* Elsewhere, or if executable memory is unavailable, it falls back to
+* the portable code. Generating the code takes a while, so this is for
+* codecs that are used many times.
+*/
+class fec_jit_kernel
+   {
+   public:
+      /**
+      * @param matrix rows*cols coefficients; output i is the sum of
+      *        matrix[i*cols + j] times input j
+      * @param rows the number of outputs
+      * @param cols the number of inputs
+      */
+      fec_jit_kernel(const uint8_t matrix[], size_t rows, size_t cols);
+
+      /**
+      * @param code the code
+      * @return a kernel computing the N-K parity shares from the K
+      *         data blocks
+      */
+      static fec_jit_kernel encoder(const fec_code& code);
+
+      /**
+      * @param code the code
+      * @param share_ids the K shares that will be decoded from, in the
+      *        order they will be passed to apply
+      * @return a kernel computing the K data blocks from those shares
+      */
+      static fec_jit_kernel decoder(const fec_code& code,
+                                    const std::vector<size_t>& share_ids);
+
+      size_t get_rows() const { return rows; }
+      size_t get_cols() const { return cols; }
+
+      /**
+      * @return true if machine code was generated for this matrix
+      */
+      bool compiled() const { return static_cast<bool>(kernel); }
+
+      /**
+      * @param in the cols inputs
+      * @param out the rows outputs, which are overwritten
+      * @param size the length in bytes of each input and output
+      */
+      void apply(const uint8_t* const in[], uint8_t* const out[],
+                 size_t size) const;
+
+   private:
+      size_t rows, cols;
+      std::vector<uint8_t> matrix;
+      std::shared_ptr<void> kernel;
+   };
+
+/*
+* addmul for any target, using GCC vector extensions; handles multiples
+* of 16 bytes and returns the number of bytes left over
+*/
+size_t addmul_generic(uint8_t z[], const uint8_t x[], uint8_t y, size_t size);
+
+void addmul_generic_window(uint8_t z[], const uint8_t x[], uint8_t y,
+                           size_t first, size_t last);
+
+/*
+* Machine code generation for fec_jit_kernel. The kernel handles a
+* multiple of 16 bytes; null is returned if code can't be generated.
+*/
+typedef void (*jit_kernel_fn)(const uint8_t* const in[],
+                              uint8_t* const out[], size_t size);
+
+jit_kernel_fn jit_matrix_kernel(const uint8_t matrix[], size_t rows, size_t cols,
+                                const uint8_t mul_table[256][256]);
+
+void jit_release(jit_kernel_fn kernel);
+
 #if defined(FECPP_IS_X86)
 
 /**
@@ -74,9 +1198,27 @@ class fec_code
 */
 bool has_sse2();
 bool has_ssse3();
+bool has_sse42();
+bool has_avx2();
 
 size_t addmul_sse2(uint8_t z[], const uint8_t x[], uint8_t y, size_t size);
 size_t addmul_ssse3(uint8_t z[], const uint8_t x[], uint8_t y, size_t size);
+void addmul_ssse3_window(uint8_t z[], const uint8_t x[], uint8_t y,
+                         size_t first, size_t last);
+
+bool is_zero_sse2(const uint8_t buf[], size_t size);
+
+size_t dot_compare_ssse3(const uint8_t p[], const uint8_t* const x[],
+                         const uint8_t y[], size_t n, size_t size);
+
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t buf[], size_t len);
+
+extern const uint32_t SHA256_K[64];
+
+void sha256_x4_sse2(uint32_t* const state[], const uint8_t* const data[],
+                    size_t blocks);
+void sha256_x8_avx2(uint32_t* const state[], const uint8_t* const data[],
+                    size_t blocks);
 
 #endif
 
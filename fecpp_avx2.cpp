@@ -0,0 +1,120 @@
+/*
+ * AVX2 routines: eight way SHA-256
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#include "fecpp.h"
+
+#if defined(FECPP_IS_X86)
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace fecpp {
+
+namespace {
+
+inline uint32_t sha256_word(const uint8_t p[])
+   {
+   uint32_t w;
+   std::memcpy(&w, p, 4);
+   return __builtin_bswap32(w);
+   }
+
+}
+
+#define ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+/*
+* SHA-256 compression of eight messages at once, one in each 32-bit lane
+*/
+void sha256_x8_avx2(uint32_t* const state[], const uint8_t* const data[],
+                    size_t blocks)
+   {
+   __m256i s[8];
+   for(size_t j = 0; j != 8; ++j)
+      s[j] = _mm256_set_epi32(state[7][j], state[6][j], state[5][j],
+                              state[4][j], state[3][j], state[2][j],
+                              state[1][j], state[0][j]);
+
+   __m256i W[64];
+
+   for(size_t i = 0; i != blocks; ++i)
+      {
+      for(size_t t = 0; t != 16; ++t)
+         {
+         const size_t off = 64*i + 4*t;
+         W[t] = _mm256_set_epi32(sha256_word(data[7] + off),
+                                 sha256_word(data[6] + off),
+                                 sha256_word(data[5] + off),
+                                 sha256_word(data[4] + off),
+                                 sha256_word(data[3] + off),
+                                 sha256_word(data[2] + off),
+                                 sha256_word(data[1] + off),
+                                 sha256_word(data[0] + off));
+         }
+
+      for(size_t t = 16; t != 64; ++t)
+         {
+         const __m256i s0 = _mm256_xor_si256(
+            _mm256_xor_si256(ROTR(W[t-15], 7), ROTR(W[t-15], 18)),
+            _mm256_srli_epi32(W[t-15], 3));
+         const __m256i s1 = _mm256_xor_si256(
+            _mm256_xor_si256(ROTR(W[t-2], 17), ROTR(W[t-2], 19)),
+            _mm256_srli_epi32(W[t-2], 10));
+         W[t] = _mm256_add_epi32(_mm256_add_epi32(W[t-16], s0),
+                             _mm256_add_epi32(W[t-7], s1));
+         }
+
+      __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+      __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+
+      for(size_t t = 0; t != 64; ++t)
+         {
+         const __m256i S1 = _mm256_xor_si256(
+            _mm256_xor_si256(ROTR(e, 6), ROTR(e, 11)), ROTR(e, 25));
+         const __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f),
+                                         _mm256_andnot_si256(e, g));
+         const __m256i T1 = _mm256_add_epi32(
+            _mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, W[t])),
+            _mm256_set1_epi32(SHA256_K[t]));
+         const __m256i S0 = _mm256_xor_si256(
+            _mm256_xor_si256(ROTR(a, 2), ROTR(a, 13)), ROTR(a, 22));
+         const __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b),
+                                        _mm256_and_si256(c, _mm256_or_si256(a, b)));
+
+         h = g;
+         g = f;
+         f = e;
+         e = _mm256_add_epi32(d, T1);
+         d = c;
+         c = b;
+         b = a;
+         a = _mm256_add_epi32(T1, _mm256_add_epi32(S0, maj));
+         }
+
+      s[0] = _mm256_add_epi32(s[0], a);
+      s[1] = _mm256_add_epi32(s[1], b);
+      s[2] = _mm256_add_epi32(s[2], c);
+      s[3] = _mm256_add_epi32(s[3], d);
+      s[4] = _mm256_add_epi32(s[4], e);
+      s[5] = _mm256_add_epi32(s[5], f);
+      s[6] = _mm256_add_epi32(s[6], g);
+      s[7] = _mm256_add_epi32(s[7], h);
+      }
+
+   for(size_t j = 0; j != 8; ++j)
+      {
+      uint32_t lanes[8];
+      _mm256_storeu_si256((__m256i*)lanes, s[j]);
+      for(size_t l = 0; l != 8; ++l)
+         state[l][j] = lanes[l];
+      }
+   }
+
+#undef ROTR
+
+}
+
+#endif
@@ -0,0 +1,245 @@
+/*
+ * C interface to fecpp
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#include "fecpp_c.h"
+#include "fecpp.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace fecpp;
+
+struct fecpp_code
+   {
+   size_t K, N;
+
+   // the parity rows of the encoding matrix, (N-K)*K
+   std::vector<uint8_t> parity_rows;
+
+   // decoding scratch
+   std::vector<size_t> position;
+   std::vector<const uint8_t*> used;
+   std::vector<uint8_t> matrix, inverse;
+   };
+
+namespace {
+
+const size_t ABSENT = static_cast<size_t>(-1);
+
+/*
+* Invert the K*K matrix m into inv by Gauss-Jordan elimination,
+* without allocating; m is destroyed. Returns false if m is singular.
+*/
+bool invert(uint8_t m[], uint8_t inv[], size_t K)
+   {
+   std::memset(inv, 0, K*K);
+   for(size_t i = 0; i != K; ++i)
+      inv[i*K + i] = 1;
+
+   for(size_t col = 0; col != K; ++col)
+      {
+      size_t pivot = col;
+      while(pivot != K && m[pivot*K + col] == 0)
+         ++pivot;
+
+      if(pivot == K)
+         return false;
+
+      if(pivot != col)
+         {
+         std::swap_ranges(m + pivot*K, m + pivot*K + K, m + col*K);
+         std::swap_ranges(inv + pivot*K, inv + pivot*K + K, inv + col*K);
+         }
+
+      const uint8_t c = gf::inverse(m[col*K + col]);
+      gf::mul_region(m + col*K, m + col*K, c, K);
+      gf::mul_region(inv + col*K, inv + col*K, c, K);
+
+      for(size_t row = 0; row != K; ++row)
+         {
+         const uint8_t f = m[row*K + col];
+         if(row == col || f == 0)
+            continue;
+
+         gf::addmul_region(m + row*K, m + col*K, f, K);
+         gf::addmul_region(inv + row*K, inv + col*K, f, K);
+         }
+      }
+
+   return true;
+   }
+
+}
+
+int fecpp_code_create(fecpp_code** code, size_t k, size_t n)
+   {
+   if(!code || k < 1 || k > n || n > 256)
+      return FECPP_ERROR_ARGUMENT;
+
+   *code = nullptr;
+
+   try
+      {
+      std::shared_ptr<const fec_code> fec = shared_fec_code(k, n);
+
+      // the serialized form is a 7 byte header, the parity rows, and
+      // a 4 byte CRC32C
+      const std::vector<uint8_t> rows = fec->serialize();
+
+      fecpp_code* c = new fecpp_code;
+      c->K = k;
+      c->N = n;
+      c->parity_rows.assign(rows.begin() + 7, rows.end() - 4);
+      c->position.resize(n);
+      c->used.resize(k);
+      c->matrix.resize(k*k);
+      c->inverse.resize(k*k);
+
+      *code = c;
+      return FECPP_OK;
+      }
+   catch(std::bad_alloc&)
+      {
+      return FECPP_ERROR_MEMORY;
+      }
+   catch(...)
+      {
+      return FECPP_ERROR_INTERNAL;
+      }
+   }
+
+void fecpp_code_destroy(fecpp_code* code)
+   {
+   delete code;
+   }
+
+size_t fecpp_code_k(const fecpp_code* code)
+   {
+   return code ? code->K : 0;
+   }
+
+size_t fecpp_code_n(const fecpp_code* code)
+   {
+   return code ? code->N : 0;
+   }
+
+int fecpp_encode(const fecpp_code* code,
+                 const uint8_t* const data[],
+                 uint8_t* const parity[],
+                 size_t block_size)
+   {
+   if(!code || !data || (!parity && code->N != code->K))
+      return FECPP_ERROR_ARGUMENT;
+
+   try
+      {
+      gf::matrix_mul(code->parity_rows.data(), code->N - code->K, code->K,
+                     data, parity, block_size);
+      return FECPP_OK;
+      }
+   catch(...)
+      {
+      return FECPP_ERROR_INTERNAL;
+      }
+   }
+
+/*
+* Use the data shares that are present, and fill in for the rest with
+* parity shares; the data blocks are the inverse of the rows of the
+* encoding matrix for those shares times the shares
+*/
+int fecpp_decode(fecpp_code* code,
+                 const size_t share_ids[],
+                 const uint8_t* const shares[],
+                 size_t count,
+                 uint8_t* const out[],
+                 size_t share_size)
+   {
+   if(!code || !share_ids || !shares || !out)
+      return FECPP_ERROR_ARGUMENT;
+
+   const size_t K = code->K, N = code->N;
+   size_t* position = code->position.data();
+
+   std::fill(position, position + N, ABSENT);
+
+   size_t distinct = 0;
+   for(size_t i = 0; i != count; ++i)
+      {
+      if(share_ids[i] >= N || !shares[i])
+         return FECPP_ERROR_ARGUMENT;
+      if(position[share_ids[i]] == ABSENT)
+         {
+         position[share_ids[i]] = i;
+         ++distinct;
+         }
+      }
+
+   if(distinct < K)
+      return FECPP_ERROR_SHARES;
+
+   try
+      {
+      bool missing = false;
+      size_t next_parity = N;
+
+      for(size_t i = 0; i != K; ++i)
+         {
+         uint8_t* row = &code->matrix[i*K];
+
+         if(position[i] != ABSENT)
+            {
+            std::memset(row, 0, K);
+            row[i] = 1;
+            code->used[i] = shares[position[i]];
+            continue;
+            }
+
+         missing = true;
+         while(position[--next_parity] == ABSENT)
+            ;
+
+         std::memcpy(row, &code->parity_rows[(next_parity - K)*K], K);
+         code->used[i] = shares[position[next_parity]];
+         }
+
+      if(missing && !invert(code->matrix.data(), code->inverse.data(), K))
+         return FECPP_ERROR_INTERNAL;
+
+      for(size_t i = 0; i != K; ++i)
+         {
+         if(position[i] == ABSENT)
+            gf::dot_region(out[i], code->used.data(), &code->inverse[i*K],
+                           K, share_size);
+         else if(out[i] != code->used[i])
+            std::memcpy(out[i], code->used[i], share_size);
+         }
+
+      return FECPP_OK;
+      }
+   catch(...)
+      {
+      return FECPP_ERROR_INTERNAL;
+      }
+   }
+
+const char* fecpp_error_string(int error)
+   {
+   switch(error)
+      {
+      case FECPP_OK:
+         return "no error";
+      case FECPP_ERROR_ARGUMENT:
+         return "invalid argument";
+      case FECPP_ERROR_SHARES:
+         return "fewer than K distinct shares";
+      case FECPP_ERROR_MEMORY:
+         return "out of memory";
+      case FECPP_ERROR_INTERNAL:
+         return "internal error";
+      }
+   return "unknown error";
+   }
@@ -0,0 +1,90 @@
+/*
+ * C interface to fecpp
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#ifndef FECPP_C_H_
+#define FECPP_C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Return codes; everything except fecpp_code_destroy and the getters
+* returns one of these, and no C++ exception ever escapes
+*/
+#define FECPP_OK                 0
+#define FECPP_ERROR_ARGUMENT    -1 /* null pointer, bad K/N or share id */
+#define FECPP_ERROR_SHARES      -2 /* fewer than K distinct shares */
+#define FECPP_ERROR_MEMORY      -3 /* allocation failed (creation only) */
+#define FECPP_ERROR_INTERNAL    -4
+
+/*
+* An opaque handle to a code, equivalent to fec_code(K, N) and
+* producing identical shares. All memory is allocated when the handle
+* is created; encoding and decoding only use the caller's buffers and
+* scratch space kept in the handle. Any number of threads may encode
+* with the same handle, but decoding uses the scratch space, so a
+* handle must only be decoded with by one thread at a time.
+*/
+typedef struct fecpp_code fecpp_code;
+
+/*
+* Create a code
+* @param code set to the new handle on success
+* @param k the number of shares needed for recovery, 1...n
+* @param n the number of shares generated, at most 256
+*/
+int fecpp_code_create(fecpp_code** code, size_t k, size_t n);
+
+/*
+* Free a code; null is ignored
+*/
+void fecpp_code_destroy(fecpp_code* code);
+
+size_t fecpp_code_k(const fecpp_code* code);
+size_t fecpp_code_n(const fecpp_code* code);
+
+/*
+* Compute the parity shares. The data shares are the data blocks
+* themselves.
+* @param data the K data blocks
+* @param parity where to write the N-K parity shares K...N-1
+* @param block_size the length in bytes of each block and share
+*/
+int fecpp_encode(const fecpp_code* code,
+                 const uint8_t* const data[],
+                 uint8_t* const parity[],
+                 size_t block_size);
+
+/*
+* Recover the data blocks from any K of the shares
+* @param share_ids the ids of the shares available
+* @param shares the shares, in the same order as share_ids
+* @param count the number of shares available, at least K
+* @param out where to write the K data blocks; these must not overlap
+*        the shares, except that out[i] may be the data share i itself
+* @param share_size the length in bytes of each share
+*/
+int fecpp_decode(fecpp_code* code,
+                 const size_t share_ids[],
+                 const uint8_t* const shares[],
+                 size_t count,
+                 uint8_t* const out[],
+                 size_t share_size);
+
+/*
+* @return a description of a return code
+*/
+const char* fecpp_error_string(int error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,380 @@
+/*
+ * Forward error correction with the code fixed at compile time
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#ifndef FECPP_FIXED_H_
+#define FECPP_FIXED_H_
+
+#include "fecpp.h"
+#include "fecpp_simd.h"
+#include <cstring>
+#include <stdexcept>
+#include <initializer_list>
+#include <utility>
+
+namespace fecpp {
+
+namespace fixed_detail {
+
+/*
+* GF(2^8) arithmetic using the same polynomial as fecpp.cpp, written
+* so that it can be evaluated at compile time
+*/
+constexpr uint8_t gf_mul(uint8_t a, uint8_t b)
+   {
+   uint8_t r = 0;
+   while(b)
+      {
+      if(b & 1)
+         r ^= a;
+      a = static_cast<uint8_t>((a << 1) ^ ((a & 0x80) ? 0x1D : 0));
+      b >>= 1;
+      }
+   return r;
+   }
+
+constexpr uint8_t gf_exp(size_t i)
+   {
+   uint8_t r = 1;
+   for(size_t j = 0; j != i % 255; ++j)
+      r = gf_mul(r, 2);
+   return r;
+   }
+
+constexpr uint8_t gf_inverse(uint8_t a)
+   {
+   // a^254 = a^-1
+   uint8_t r = 1;
+   for(size_t i = 0; i != 254; ++i)
+      r = gf_mul(r, a);
+   return r;
+   }
+
+template<size_t K, size_t N>
+struct parity_matrix
+   {
+   uint8_t coef[(N - K) * K ? (N - K) * K : 1];
+   };
+
+/*
+* The parity rows of fec_code(K, N)'s encoding matrix, computed the
+* same way as create_inverted_vdm and build_parity_rows
+*/
+template<size_t K, size_t N>
+constexpr parity_matrix<K, N> make_parity_matrix()
+   {
+   uint8_t inv[K * K] = {};
+
+   if(K == 1)
+      inv[0] = 1;
+   else
+      {
+      uint8_t b[K] = {}, c[K] = {};
+
+      for(size_t i = 1; i < K; ++i)
+         {
+         for(size_t j = K-1 - (i - 1); j < K-1; ++j)
+            c[j] ^= gf_mul(gf_exp(i), c[j+1]);
+         c[K-1] ^= gf_exp(i);
+         }
+
+      for(size_t row = 0; row < K; ++row)
+         {
+         const uint8_t p_row = (row == 0) ? 0 : gf_exp(row);
+
+         uint8_t t = 1;
+         b[K-1] = 1;
+         for(size_t i = K-1; i-- != 0; )
+            {
+            b[i] = c[i+1] ^ gf_mul(p_row, b[i+1]);
+            t = b[i] ^ gf_mul(p_row, t);
+            }
+
+         const uint8_t t_inv = gf_inverse(t);
+         for(size_t col = 0; col != K; ++col)
+            inv[col*K + row] = gf_mul(t_inv, b[col]);
+         }
+      }
+
+   parity_matrix<K, N> m = {};
+
+   for(size_t row = K; row != N; ++row)
+      for(size_t col = 0; col != K; ++col)
+         {
+         uint8_t acc = 0;
+         for(size_t i = 0; i != K; ++i)
+            acc ^= gf_mul(gf_exp(row * i), inv[i*K + col]);
+         m.coef[(row - K)*K + col] = acc;
+         }
+
+   return m;
+   }
+
+using simd::vec16;
+using simd::xtime;
+
+#if defined(FECPP_SIMD_SHUFFLE)
+
+using simd::shuffle;
+
+/*
+* Multiplying by a constant using the two 16 entry tables of C times
+* each low and high nibble. This needs a byte shuffle instruction
+* (SSSE3 or NEON) to be fast.
+*/
+struct shuffle_mul
+   {
+   struct split
+      {
+      vec16 lo, hi;
+      };
+
+   static split prepare(vec16 v)
+      {
+      const split s = { v & 0x0F, v >> 4 };
+      return s;
+      }
+
+   template<uint8_t C>
+   static vec16 mul(const split& x)
+      {
+      const vec16 lo = {
+         gf_mul(C, 0x00), gf_mul(C, 0x01), gf_mul(C, 0x02), gf_mul(C, 0x03),
+         gf_mul(C, 0x04), gf_mul(C, 0x05), gf_mul(C, 0x06), gf_mul(C, 0x07),
+         gf_mul(C, 0x08), gf_mul(C, 0x09), gf_mul(C, 0x0A), gf_mul(C, 0x0B),
+         gf_mul(C, 0x0C), gf_mul(C, 0x0D), gf_mul(C, 0x0E), gf_mul(C, 0x0F) };
+      const vec16 hi = {
+         gf_mul(C, 0x00), gf_mul(C, 0x10), gf_mul(C, 0x20), gf_mul(C, 0x30),
+         gf_mul(C, 0x40), gf_mul(C, 0x50), gf_mul(C, 0x60), gf_mul(C, 0x70),
+         gf_mul(C, 0x80), gf_mul(C, 0x90), gf_mul(C, 0xA0), gf_mul(C, 0xB0),
+         gf_mul(C, 0xC0), gf_mul(C, 0xD0), gf_mul(C, 0xE0), gf_mul(C, 0xF0) };
+
+      if(C == 0)
+         return vec16{};
+      if(C == 1)
+         return x.lo ^ (x.hi << 4);
+
+      return shuffle(lo, x.lo) ^ shuffle(hi, x.hi);
+      }
+   };
+
+#endif
+
+/*
+* Multiplying by a constant by computing x*2^b for each bit b, and
+* adding up those for the bits set in C; only needs shifts and XOR
+*/
+struct xtime_mul
+   {
+   struct split
+      {
+      vec16 pow[8];
+      };
+
+   static split prepare(vec16 v)
+      {
+      split s;
+      s.pow[0] = v;
+      for(size_t b = 1; b != 8; ++b)
+         s.pow[b] = xtime(s.pow[b-1]);
+      return s;
+      }
+
+   template<uint8_t C>
+   static vec16 mul(const split& x)
+      {
+      const vec16 zero = {};
+      return ((C & 0x01) ? x.pow[0] : zero) ^ ((C & 0x02) ? x.pow[1] : zero) ^
+             ((C & 0x04) ? x.pow[2] : zero) ^ ((C & 0x08) ? x.pow[3] : zero) ^
+             ((C & 0x10) ? x.pow[4] : zero) ^ ((C & 0x20) ? x.pow[5] : zero) ^
+             ((C & 0x40) ? x.pow[6] : zero) ^ ((C & 0x80) ? x.pow[7] : zero);
+      }
+   };
+
+#if defined(FECPP_SIMD_SHUFFLE) && (defined(__SSSE3__) || defined(__ARM_NEON))
+   typedef shuffle_mul default_mul;
+#else
+   typedef xtime_mul default_mul;
+
+   #if defined(FECPP_SIMD_SHUFFLE)
+      #define FECPP_FIXED_SSSE3_DISPATCH
+   #endif
+#endif
+
+}
+
+/**
+* A systematic code like fec_code(K, N), with the encoding matrix
+* computed at compile time. Encoding is fully unrolled over the input
+* blocks and parity shares, with each coefficient turned into a fixed
+* sequence of shifts and XORs. This avoids matrix lookups and per-call
+* table setup, which dominate for small shares.
+*
+* The shares are identical to those of fec_code(K, N), so they can be
+* decoded with that. The matrix is built by the compiler, so this is
+* meant for a few small geometries such as 4+2 or 10+4.
+*/
+template<size_t K, size_t N>
+class fec_code_fixed
+   {
+   static_assert(K >= 1 && K <= N && N <= 256,
+                 "fec_code_fixed: violated 1 <= K <= N <= 256");
+
+   public:
+      static constexpr size_t get_K() { return K; }
+      static constexpr size_t get_N() { return N; }
+
+      /**
+      * The parity rows of the encoding matrix, (N-K)*K coefficients
+      */
+      static constexpr fixed_detail::parity_matrix<K, N> matrix =
+         fixed_detail::make_parity_matrix<K, N>();
+
+      /**
+      * @param input the data to FEC
+      * @param size the length in bytes of input
+      * @param out the output callback
+      */
+      void encode(
+         const uint8_t input[], size_t size,
+         std::function<void (size_t, size_t, const uint8_t[], size_t)> out)
+         const
+         {
+         if(size % K != 0)
+            throw std::invalid_argument("encode: input must be multiple of K bytes");
+
+         const size_t block_size = size / K;
+
+         const uint8_t* data[K];
+         for(size_t i = 0; i != K; ++i)
+            {
+            data[i] = input + i*block_size;
+            out(i, N, data[i], block_size);
+            }
+
+         if(N == K)
+            return;
+
+         std::vector<uint8_t> buf((N - K) * block_size);
+         uint8_t* parity[N - K ? N - K : 1];
+         for(size_t i = 0; i != N - K; ++i)
+            parity[i] = &buf[i*block_size];
+
+         encode_parity(data, block_size, parity);
+
+         for(size_t i = 0; i != N - K; ++i)
+            out(K + i, N, parity[i], block_size);
+         }
+
+      /**
+      * Compute all parity shares without allocating
+      * @param data the K data blocks
+      * @param block_size the length in bytes of each block
+      * @param parity where to write the N-K parity shares
+      */
+      static void encode_parity(const uint8_t* const data[],
+                                size_t block_size,
+                                uint8_t* const parity[])
+         {
+#if defined(FECPP_FIXED_SSSE3_DISPATCH)
+         if(has_ssse3())
+            return encode_parity_ssse3(data, block_size, parity);
+#endif
+
+         encode_parity_with<fixed_detail::default_mul>(data, block_size, parity);
+         }
+
+   private:
+      typedef fixed_detail::vec16 vec16;
+
+#if defined(FECPP_FIXED_SSSE3_DISPATCH)
+      /*
+      * Everything is inlined into this, so the shuffles compile to
+      * pshufb even though the rest of the program is built without
+      * SSSE3
+      */
+      __attribute__((target("ssse3"), flatten))
+      static void encode_parity_ssse3(const uint8_t* const data[],
+                                      size_t block_size,
+                                      uint8_t* const parity[])
+         {
+         encode_parity_with<fixed_detail::shuffle_mul>(data, block_size, parity);
+         }
+#endif
+
+      template<typename M>
+      static void encode_parity_with(const uint8_t* const data[],
+                                     size_t block_size,
+                                     uint8_t* const parity[])
+         {
+         typedef std::make_index_sequence<K> columns;
+
+         size_t done = 0;
+
+         for(; done + 16 <= block_size; done += 16)
+            chunk<M>(data, parity, done, columns());
+
+         if(done == block_size)
+            return;
+
+         // zero pad the tail out to a full vector
+         const size_t left = block_size - done;
+         uint8_t tail_in[K][16] = {}, tail_out[N - K ? N - K : 1][16];
+         const uint8_t* tail_data[K];
+         uint8_t* tail_parity[N - K ? N - K : 1];
+
+         for(size_t i = 0; i != K; ++i)
+            {
+            std::memcpy(tail_in[i], data[i] + done, left);
+            tail_data[i] = tail_in[i];
+            }
+         for(size_t i = 0; i != N - K; ++i)
+            tail_parity[i] = tail_out[i];
+
+         chunk<M>(tail_data, tail_parity, 0, columns());
+
+         for(size_t i = 0; i != N - K; ++i)
+            std::memcpy(parity[i] + done, tail_out[i], left);
+         }
+
+      template<typename M, size_t J, size_t... I>
+      static void column(vec16 acc[], vec16 x, std::index_sequence<I...>)
+         {
+         const typename M::split parts = M::prepare(x);
+         (void)parts; // unused if N == K
+
+         (void)std::initializer_list<int>{
+            (acc[I] ^= M::template mul<matrix.coef[I*K + J]>(parts), 0)... };
+         }
+
+      template<typename M, size_t... J>
+      static void chunk(const uint8_t* const data[], uint8_t* const parity[],
+                        size_t offset, std::index_sequence<J...>)
+         {
+         typedef std::make_index_sequence<N - K> rows;
+
+         vec16 acc[N - K ? N - K : 1] = {};
+
+         (void)std::initializer_list<int>{
+            (column<M, J>(acc, load(data[J] + offset), rows()), 0)... };
+
+         for(size_t i = 0; i != N - K; ++i)
+            std::memcpy(parity[i] + offset, &acc[i], 16);
+         }
+
+      static vec16 load(const uint8_t in[])
+         {
+         vec16 v;
+         std::memcpy(&v, in, 16);
+         return v;
+         }
+   };
+
+template<size_t K, size_t N>
+constexpr fixed_detail::parity_matrix<K, N> fec_code_fixed<K, N>::matrix;
+
+}
+
+#endif
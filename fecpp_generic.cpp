@@ -0,0 +1,139 @@
+/*
+ * Portable SIMD routines using GCC/Clang vector extensions
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#include "fecpp.h"
+#include "fecpp_simd.h"
+#include <cstring>
+
+/*
+* On x86 the shuffle is only used if this file is built with SSSE3;
+* otherwise the mask path below is used, since addmul_ssse3 covers
+* CPUs with it
+*/
+#if defined(FECPP_SIMD_SHUFFLE) && (!defined(FECPP_IS_X86) || defined(__SSSE3__))
+   #define FECPP_GENERIC_SHUFFLE
+#endif
+
+namespace fecpp {
+
+namespace {
+
+using simd::vec16;
+using simd::xtime;
+
+/*
+* Multiply each byte by y, adding up v*x^b for each bit b set in y
+*/
+inline vec16 mul(vec16 v, uint8_t y)
+   {
+   vec16 r = {};
+   for(; y; y >>= 1)
+      {
+      if(y & 1)
+         r ^= v;
+      v = xtime(v);
+      }
+   return r;
+   }
+
+inline vec16 load(const uint8_t in[])
+   {
+   vec16 v;
+   std::memcpy(&v, in, 16);
+   return v;
+   }
+
+inline void store(uint8_t out[], vec16 v)
+   {
+   std::memcpy(out, &v, 16);
+   }
+
+#if defined(FECPP_GENERIC_SHUFFLE)
+using simd::shuffle;
+#endif
+
+}
+
+/*
+* addmul using only GCC vector extensions, for any target. Where there
+* is a byte shuffle (NEON, SSSE3) multiplying is two lookups in tables
+* of y times each nibble; otherwise it is done a bit at a time, with
+* the bits of y turned into masks up front.
+*/
+size_t addmul_generic(uint8_t z[], const uint8_t x[], uint8_t y, size_t size)
+   {
+   if(y == 0 || size < 16)
+      return size % 16;
+
+#if defined(FECPP_GENERIC_SHUFFLE)
+   const vec16 nibbles = { 0, 1, 2, 3, 4, 5, 6, 7,
+                           8, 9, 10, 11, 12, 13, 14, 15 };
+   const vec16 lo = mul(nibbles, y);
+   const vec16 hi = mul(nibbles << 4, y);
+
+   while(size >= 16)
+      {
+      const vec16 v = load(x);
+      store(z, load(z) ^ shuffle(lo, v & 0x0F) ^ shuffle(hi, v >> 4));
+      x += 16;
+      z += 16;
+      size -= 16;
+      }
+#else
+   vec16 masks[8];
+   size_t bits = 0;
+   for(uint8_t b = y; b; b >>= 1)
+      {
+      const vec16 zero = {};
+      masks[bits++] = zero - (b & 1);
+      }
+
+   while(size >= 32)
+      {
+      vec16 v0 = load(x), v1 = load(x + 16);
+      vec16 r0 = v0 & masks[0], r1 = v1 & masks[0];
+
+      for(size_t b = 1; b < bits; ++b)
+         {
+         v0 = xtime(v0);
+         v1 = xtime(v1);
+         r0 ^= v0 & masks[b];
+         r1 ^= v1 & masks[b];
+         }
+
+      store(z, load(z) ^ r0);
+      store(z + 16, load(z + 16) ^ r1);
+      x += 32;
+      z += 32;
+      size -= 32;
+      }
+
+   if(size >= 16)
+      {
+      store(z, load(z) ^ mul(load(x), y));
+      x += 16;
+      z += 16;
+      size -= 16;
+      }
+#endif
+
+   return size;
+   }
+
+/*
+* addmul over the 16 bytes at z, changing only bytes first...last-1
+*/
+void addmul_generic_window(uint8_t z[], const uint8_t x[], uint8_t y,
+                           size_t first, size_t last)
+   {
+   const vec16 index = { 0, 1, 2, 3, 4, 5, 6, 7,
+                         8, 9, 10, 11, 12, 13, 14, 15 };
+   const vec16 keep = (vec16)((index >= (uint8_t)first) & (index < (uint8_t)last));
+
+   store(z, load(z) ^ (mul(load(x), y) & keep));
+   }
+
+}
@@ -0,0 +1,352 @@
+/*
+ * Machine code generation for fec_jit_kernel
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#include "fecpp.h"
+#include <cstring>
+
+#if defined(FECPP_IS_X86) && defined(__x86_64__) && \
+    (defined(__unix__) || defined(__APPLE__))
+  #include <sys/mman.h>
+  #define FECPP_JIT_X86_64
+#endif
+
+namespace fecpp {
+
+#if defined(FECPP_JIT_X86_64)
+
+namespace {
+
+enum { RAX = 0, RCX = 1, RDX = 2, RSI = 6, RDI = 7, R10 = 10, R11 = 11 };
+
+/*
+* Just enough of an x86-64 assembler for SSSE3 kernels. Every register
+* operand is a number 0...15, xmm or general purpose depending on the
+* instruction.
+*/
+class assembler
+   {
+   public:
+      std::vector<uint8_t> code;
+
+      void movdqu_load_indexed(int xmm, int base, int index)
+         { mem_index(0xF3, 0x6F, xmm, base, index); }
+
+      void movdqu_store_indexed(int base, int index, int xmm)
+         { mem_index(0xF3, 0x7F, xmm, base, index); }
+
+      void movdqu_load(int xmm, int base, int32_t disp)
+         { mem_disp(0xF3, 0x6F, xmm, base, disp, false); }
+
+      void movdqa(int dst, int src) { reg_reg(0x66, 0x6F, dst, src); }
+      void pxor(int dst, int src) { reg_reg(0x66, 0xEF, dst, src); }
+      void pand(int dst, int src) { reg_reg(0x66, 0xDB, dst, src); }
+
+      void pshufb(int dst, int src)
+         {
+         emit(0x66);
+         rex(false, dst, 0, src);
+         emit(0x0F);
+         emit(0x38);
+         emit(0x00);
+         emit(0xC0 | (dst & 7) << 3 | (src & 7));
+         }
+
+      void psrlw(int xmm, uint8_t bits)
+         {
+         emit(0x66);
+         rex(false, 0, 0, xmm);
+         emit(0x0F);
+         emit(0x71);
+         emit(0xC0 | 2 << 3 | (xmm & 7));
+         emit(bits);
+         }
+
+      void mov_load(int reg, int base, int32_t disp)
+         { mem_disp(0, 0x8B, reg, base, disp, true); }
+
+      // lea rcx, [rip + disp], disp relative to the next instruction
+      void lea_rcx_rip(int32_t disp)
+         {
+         emit(0x48);
+         emit(0x8D);
+         emit(0x0D);
+         emit32(disp);
+         }
+
+      void xor_eax_eax() { emit(0x31); emit(0xC0); }
+      void add_rax(uint8_t imm) { emit(0x48); emit(0x83); emit(0xC0); emit(imm); }
+      void cmp_rax_rdx() { emit(0x48); emit(0x39); emit(0xD0); }
+
+      void jb(size_t target)
+         {
+         emit(0x0F);
+         emit(0x82);
+         emit32(static_cast<int32_t>(target - (code.size() + 4)));
+         }
+
+      void ret() { emit(0xC3); }
+
+   private:
+      void emit(uint8_t b) { code.push_back(b); }
+
+      void emit32(int32_t v)
+         {
+         for(size_t i = 0; i != 4; ++i)
+            emit(static_cast<uint8_t>(static_cast<uint32_t>(v) >> (8*i)));
+         }
+
+      void rex(bool w, int reg, int index, int base)
+         {
+         const uint8_t r = 0x40 | (w << 3) | ((reg >> 3) & 1) << 2 |
+                           ((index >> 3) & 1) << 1 | ((base >> 3) & 1);
+         if(r != 0x40)
+            emit(r);
+         }
+
+      void reg_reg(uint8_t prefix, uint8_t op, int reg, int rm)
+         {
+         emit(prefix);
+         rex(false, reg, 0, rm);
+         emit(0x0F);
+         emit(op);
+         emit(0xC0 | (reg & 7) << 3 | (rm & 7));
+         }
+
+      // op reg, [base + index]; base must not be rbp or r13
+      void mem_index(uint8_t prefix, uint8_t op, int reg, int base, int index)
+         {
+         emit(prefix);
+         rex(false, reg, index, base);
+         emit(0x0F);
+         emit(op);
+         emit(0x04 | (reg & 7) << 3);
+         emit((index & 7) << 3 | (base & 7));
+         }
+
+      // op reg, [base + disp32]; an SSE op if there is a prefix
+      void mem_disp(uint8_t prefix, uint8_t op, int reg, int base,
+                    int32_t disp, bool wide)
+         {
+         if(prefix)
+            emit(prefix);
+         rex(wide, reg, 0, base);
+         if(prefix)
+            emit(0x0F);
+         emit(op);
+         emit(0x80 | (reg & 7) << 3 | (base & 7));
+         if((base & 7) == 4)
+            emit(0x24);
+         emit32(disp);
+         }
+   };
+
+/*
+* xmm0 holds the nibble mask, xmm1 the input, xmm2/xmm3 its low and
+* high nibbles, and xmm4 is scratch. The rest hold accumulators for a
+* group of output rows, then as many coefficient tables as fit.
+*/
+const int MASK = 0, X = 1, X_LO = 2, X_HI = 3, TMP = 4, FIRST_FREE = 5;
+const size_t MAX_GROUP = 8;
+
+const size_t HEADER = 16;
+const size_t POOL = 64;
+
+/*
+* Generate the loop computing one group of output rows; rcx points to
+* the table pool, where each coefficient c has its two tables at
+* table_at[c]
+*/
+void gen_group(assembler& as, const uint8_t matrix[], size_t cols,
+               size_t first_row, size_t group,
+               const std::vector<int32_t>& table_at)
+   {
+   // keep tables in registers, in order of first use, while they fit
+   std::vector<int> table_reg(256, -1);
+   int next_reg = FIRST_FREE + static_cast<int>(group);
+
+   for(size_t j = 0; j != cols; ++j)
+      for(size_t i = 0; i != group; ++i)
+         {
+         const uint8_t c = matrix[(first_row + i)*cols + j];
+         if(c > 1 && table_reg[c] < 0 && next_reg + 1 < 16)
+            {
+            table_reg[c] = next_reg;
+            as.movdqu_load(next_reg, RCX, table_at[c]);
+            as.movdqu_load(next_reg + 1, RCX, table_at[c] + 16);
+            next_reg += 2;
+            }
+         }
+
+   as.xor_eax_eax();
+   const size_t loop = as.code.size();
+
+   std::vector<bool> started(group);
+
+   for(size_t j = 0; j != cols; ++j)
+      {
+      bool used = false, tables = false;
+      for(size_t i = 0; i != group; ++i)
+         {
+         const uint8_t c = matrix[(first_row + i)*cols + j];
+         used = used || c != 0;
+         tables = tables || c > 1;
+         }
+
+      if(!used)
+         continue;
+
+      as.mov_load(R10, RDI, static_cast<int32_t>(8*j));
+      as.movdqu_load_indexed(X, R10, RAX);
+
+      if(tables)
+         {
+         as.movdqa(X_LO, X);
+         as.pand(X_LO, MASK);
+         as.movdqa(X_HI, X);
+         as.psrlw(X_HI, 4);
+         as.pand(X_HI, MASK);
+         }
+
+      for(size_t i = 0; i != group; ++i)
+         {
+         const uint8_t c = matrix[(first_row + i)*cols + j];
+         const int acc = FIRST_FREE + static_cast<int>(i);
+
+         if(c == 0)
+            continue;
+
+         if(c == 1)
+            {
+            if(started[i])
+               as.pxor(acc, X);
+            else
+               as.movdqa(acc, X);
+            started[i] = true;
+            continue;
+            }
+
+         // lookup of the low nibble, straight into acc if it is empty
+         const int lo = started[i] ? TMP : acc;
+         if(table_reg[c] >= 0)
+            as.movdqa(lo, table_reg[c]);
+         else
+            as.movdqu_load(lo, RCX, table_at[c]);
+         as.pshufb(lo, X_LO);
+         if(started[i])
+            as.pxor(acc, TMP);
+         started[i] = true;
+
+         if(table_reg[c] >= 0)
+            as.movdqa(TMP, table_reg[c] + 1);
+         else
+            as.movdqu_load(TMP, RCX, table_at[c] + 16);
+         as.pshufb(TMP, X_HI);
+         as.pxor(acc, TMP);
+         }
+      }
+
+   for(size_t i = 0; i != group; ++i)
+      {
+      const int acc = FIRST_FREE + static_cast<int>(i);
+
+      if(!started[i])
+         as.pxor(acc, acc);
+
+      as.mov_load(R11, RSI, static_cast<int32_t>(8*(first_row + i)));
+      as.movdqu_store_indexed(R11, RAX, acc);
+      }
+
+   as.add_rax(16);
+   as.cmp_rax_rdx();
+   as.jb(loop);
+   }
+
+}
+
+/*
+* Compile a kernel for the matrix. The mapping holds the table pool,
+* then a header recording the mapping, then the code.
+*/
+jit_kernel_fn jit_matrix_kernel(const uint8_t matrix[], size_t rows, size_t cols,
+                                const uint8_t mul_table[256][256])
+   {
+   std::vector<uint8_t> pool(16, 0x0F);
+   std::vector<int32_t> table_at(256, -1);
+
+   for(size_t i = 0; i != rows * cols; ++i)
+      {
+      const uint8_t c = matrix[i];
+      if(c > 1 && table_at[c] < 0)
+         {
+         table_at[c] = static_cast<int32_t>(pool.size());
+         for(size_t k = 0; k != 16; ++k)
+            pool.push_back(mul_table[c][k]);
+         for(size_t k = 0; k != 16; ++k)
+            pool.push_back(mul_table[c][k << 4]);
+         }
+      }
+
+   const size_t code_at = (POOL + pool.size() + HEADER + 63) / 64 * 64;
+
+   assembler as;
+   as.lea_rcx_rip(static_cast<int32_t>(POOL) - static_cast<int32_t>(code_at + 7));
+   as.movdqu_load(MASK, RCX, 0);
+
+   for(size_t first = 0; first < rows; first += MAX_GROUP)
+      gen_group(as, matrix, cols, first, std::min(MAX_GROUP, rows - first),
+                table_at);
+
+   as.ret();
+
+   const size_t length = code_at + as.code.size();
+
+   void* map = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if(map == MAP_FAILED)
+      return nullptr;
+
+   uint8_t* base = static_cast<uint8_t*>(map);
+   std::memcpy(base + POOL, pool.data(), pool.size());
+   std::memcpy(base + code_at - HEADER, &map, sizeof(map));
+   std::memcpy(base + code_at - HEADER + 8, &length, sizeof(length));
+   std::memcpy(base + code_at, as.code.data(), as.code.size());
+
+   if(::mprotect(map, length, PROT_READ | PROT_EXEC) != 0)
+      {
+      ::munmap(map, length);
+      return nullptr;
+      }
+
+   return reinterpret_cast<jit_kernel_fn>(base + code_at);
+   }
+
+void jit_release(jit_kernel_fn kernel)
+   {
+   const uint8_t* code = reinterpret_cast<const uint8_t*>(kernel);
+
+   void* map;
+   size_t length;
+   std::memcpy(&map, code - HEADER, sizeof(map));
+   std::memcpy(&length, code - HEADER + 8, sizeof(length));
+
+   ::munmap(map, length);
+   }
+
+#else
+
+jit_kernel_fn jit_matrix_kernel(const uint8_t[], size_t, size_t,
+                                const uint8_t[256][256])
+   {
+   return nullptr;
+   }
+
+void jit_release(jit_kernel_fn)
+   {
+   }
+
+#endif
+
+}
@@ -0,0 +1,285 @@
+/*
+ * Two dimensional product codes
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#include "fecpp.h"
+#include <stdexcept>
+#include <cstring>
+
+namespace fecpp {
+
+/*
+* The shares of a product code; those that are missing are null until
+* rebuilt into storage owned by the grid
+*/
+class fec_product_code::grid
+   {
+   public:
+      grid(size_t rows_arg, size_t cols_arg, size_t share_size_arg) :
+         rows(rows_arg), cols(cols_arg), share_size(share_size_arg),
+         cells(rows * cols), storage(rows * cols) {}
+
+      uint8_t* rebuild(size_t cell)
+         {
+         storage[cell].assign(share_size, 0);
+         cells[cell] = storage[cell].data();
+         return storage[cell].data();
+         }
+
+      size_t rows, cols, share_size;
+      std::vector<const uint8_t*> cells;
+      std::vector<std::vector<uint8_t> > storage;
+   };
+
+/*
+* fec_product_code constructor
+*/
+fec_product_code::fec_product_code(const fec_code& row_code_arg,
+                                   const fec_code& col_code_arg) :
+   row_code(row_code_arg), col_code(col_code_arg)
+   {
+   }
+
+/*
+* Fill in every missing share of a row or column, if it has at least
+* K shares. Returns true if anything was rebuilt.
+*/
+bool fec_product_code::repair_line(grid& g, bool is_row, size_t line) const
+   {
+   const fec_code& code = is_row ? row_code : col_code;
+   const size_t K = code.get_K();
+   const size_t N = code.get_N();
+
+   std::vector<size_t> cell(N);
+   std::map<size_t, const uint8_t*> present;
+
+   for(size_t i = 0; i != N; ++i)
+      {
+      cell[i] = is_row ? line*g.cols + i : i*g.cols + line;
+      if(g.cells[cell[i]])
+         present[i] = g.cells[cell[i]];
+      }
+
+   if(present.size() == N || present.size() < K)
+      return false;
+
+   std::vector<const uint8_t*> blocks(K);
+   bool data_missing = false;
+
+   for(size_t j = 0; j != K; ++j)
+      data_missing = data_missing || !g.cells[cell[j]];
+
+   if(data_missing)
+      {
+      code.decode(present, g.share_size,
+                  [&](size_t j, size_t, const uint8_t buf[], size_t len)
+                     {
+                     if(!g.cells[cell[j]])
+                        std::memcpy(g.rebuild(cell[j]), buf, len);
+                     });
+      }
+
+   for(size_t j = 0; j != K; ++j)
+      blocks[j] = g.cells[cell[j]];
+
+   for(size_t i = K; i != N; ++i)
+      if(!g.cells[cell[i]])
+         code.encode_parity(i, &blocks[0], g.share_size, g.rebuild(cell[i]));
+
+   return true;
+   }
+
+/*
+* Rebuild only the share at position pos of a row or column, from the
+* other shares of that line. Returns false if it has fewer than K.
+*/
+bool fec_product_code::repair_cell(grid& g, bool is_row, size_t line,
+                                   size_t pos) const
+   {
+   const fec_code& code = is_row ? row_code : col_code;
+   const size_t K = code.get_K();
+   const size_t N = code.get_N();
+
+   std::vector<size_t> cell(N);
+   std::map<size_t, const uint8_t*> present;
+
+   for(size_t i = 0; i != N; ++i)
+      {
+      cell[i] = is_row ? line*g.cols + i : i*g.cols + line;
+      if(g.cells[cell[i]])
+         present[i] = g.cells[cell[i]];
+      }
+
+   if(present.size() < K)
+      return false;
+
+   bool data_present = true;
+   for(size_t j = 0; j != K; ++j)
+      data_present = data_present && g.cells[cell[j]];
+
+   if(data_present)
+      {
+      std::vector<const uint8_t*> blocks(K);
+      for(size_t j = 0; j != K; ++j)
+         blocks[j] = g.cells[cell[j]];
+
+      code.encode_parity(pos, &blocks[0], g.share_size, g.rebuild(cell[pos]));
+      return true;
+      }
+
+   /*
+   Otherwise the share is one row of coefficients applied to the K
+   shares decode_setup picks: row pos of the inverse for a data share,
+   or the encoding matrix row times the inverse for a parity share
+   */
+   std::vector<uint8_t> m_dec;
+   std::vector<size_t> indexes;
+   std::vector<const uint8_t*> sharesv;
+
+   code.decode_setup(present, m_dec, indexes, sharesv);
+
+   std::vector<uint8_t> coefs(K);
+
+   if(pos < K)
+      std::memcpy(&coefs[0], &m_dec[pos*K], K);
+   else
+      {
+      for(size_t j = 0; j != K; ++j)
+         for(size_t col = 0; col != K; ++col)
+            coefs[col] ^= gf::mul(code.enc_matrix[pos*K + j], m_dec[j*K + col]);
+      }
+
+   uint8_t* out = g.rebuild(cell[pos]);
+   for(size_t col = 0; col != K; ++col)
+      gf::addmul_region(out, sharesv[col], coefs[col], g.share_size);
+
+   return true;
+   }
+
+/*
+* Repair rows and columns until all the wanted shares are present, or
+* no further progress can be made
+*/
+bool fec_product_code::solve(grid& g, const std::vector<size_t>& wanted) const
+   {
+   for(;;)
+      {
+      bool done = true;
+      for(size_t i = 0; i != wanted.size(); ++i)
+         done = done && g.cells[wanted[i]];
+
+      if(done)
+         return true;
+
+      bool progress = false;
+
+      for(size_t r = 0; r != g.rows; ++r)
+         progress = repair_line(g, true, r) || progress;
+
+      for(size_t c = 0; c != g.cols; ++c)
+         progress = repair_line(g, false, c) || progress;
+
+      if(!progress)
+         return false;
+      }
+   }
+
+/*
+* Product code encoding
+*/
+void fec_product_code::encode(
+   const uint8_t input[], size_t size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   const size_t K = get_K();
+
+   if(size % K != 0)
+      throw std::invalid_argument("encode: input must be multiple of K bytes");
+
+   const size_t block_size = size / K;
+   const size_t K_rows = col_code.get_K(), K_cols = row_code.get_K();
+
+   grid g(col_code.get_N(), row_code.get_N(), block_size);
+
+   for(size_t r = 0; r != K_rows; ++r)
+      for(size_t c = 0; c != K_cols; ++c)
+         g.cells[r*g.cols + c] = input + (r*K_cols + c)*block_size;
+
+   // encode the data rows, then every column including the row parity
+   for(size_t r = 0; r != K_rows; ++r)
+      repair_line(g, true, r);
+
+   for(size_t c = 0; c != g.cols; ++c)
+      repair_line(g, false, c);
+
+   for(size_t i = 0; i != g.cells.size(); ++i)
+      output(i, g.cells.size(), g.cells[i], block_size);
+   }
+
+/*
+* Product code decoding
+*/
+void fec_product_code::decode(
+   const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   const size_t K_rows = col_code.get_K(), K_cols = row_code.get_K();
+
+   grid g(col_code.get_N(), row_code.get_N(), share_size);
+
+   for(auto i = shares.begin(); i != shares.end(); ++i)
+      {
+      if(i->first >= g.cells.size())
+         throw std::logic_error("Invalid share id detected during decode");
+      g.cells[i->first] = i->second;
+      }
+
+   std::vector<size_t> data_cells;
+   for(size_t r = 0; r != K_rows; ++r)
+      for(size_t c = 0; c != K_cols; ++c)
+         data_cells.push_back(r*g.cols + c);
+
+   if(!solve(g, data_cells))
+      throw std::logic_error("Could not decode, too many shares missing from the grid");
+
+   for(size_t i = 0; i != data_cells.size(); ++i)
+      output(i, data_cells.size(), g.cells[data_cells[i]], share_size);
+   }
+
+/*
+* Rebuild a single share, as locally as possible
+*/
+void fec_product_code::repair(
+   size_t share_id,
+   const std::map<size_t, const uint8_t*>& shares, size_t share_size,
+   std::function<void (size_t, size_t, const uint8_t[], size_t)> output)
+   const
+   {
+   grid g(col_code.get_N(), row_code.get_N(), share_size);
+
+   if(share_id >= g.cells.size())
+      throw std::invalid_argument("repair: invalid share id");
+
+   for(auto i = shares.begin(); i != shares.end(); ++i)
+      {
+      if(i->first >= g.cells.size())
+         throw std::logic_error("Invalid share id detected during decode");
+      g.cells[i->first] = i->second;
+      }
+
+   const size_t row = share_id / g.cols, col = share_id % g.cols;
+
+   if(!g.cells[share_id] &&
+      !repair_cell(g, true, row, col) &&
+      !repair_cell(g, false, col, row) &&
+      !solve(g, std::vector<size_t>(1, share_id)))
+      throw std::logic_error("Could not decode, too many shares missing from the grid");
+
+   output(share_id, g.cells.size(), g.cells[share_id], share_size);
+   }
+
+}
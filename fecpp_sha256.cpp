@@ -0,0 +1,321 @@
+/*
+ * SHA-256 and the per-share hash tree
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#include "fecpp.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+namespace fecpp {
+
+extern const uint32_t SHA256_K[64] = {
+   0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+   0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+   0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+   0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+   0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+   0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+   0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+   0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+   0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+   0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+   0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2 };
+
+namespace {
+
+const uint32_t SHA256_IV[8] = {
+   0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+   0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+
+inline uint32_t rotr(uint32_t x, int n)
+   {
+   return (x >> n) | (x << (32 - n));
+   }
+
+inline uint32_t load_be32(const uint8_t p[])
+   {
+   return (static_cast<uint32_t>(p[0]) << 24) |
+          (static_cast<uint32_t>(p[1]) << 16) |
+          (static_cast<uint32_t>(p[2]) << 8) |
+          static_cast<uint32_t>(p[3]);
+   }
+
+/*
+* Process blocks 64 byte blocks of one message
+*/
+void sha256_compress(uint32_t state[8], const uint8_t data[], size_t blocks)
+   {
+   uint32_t W[64];
+
+   for(size_t i = 0; i != blocks; ++i, data += 64)
+      {
+      for(size_t t = 0; t != 16; ++t)
+         W[t] = load_be32(data + 4*t);
+
+      for(size_t t = 16; t != 64; ++t)
+         {
+         const uint32_t s0 = rotr(W[t-15], 7) ^ rotr(W[t-15], 18) ^ (W[t-15] >> 3);
+         const uint32_t s1 = rotr(W[t-2], 17) ^ rotr(W[t-2], 19) ^ (W[t-2] >> 10);
+         W[t] = W[t-16] + s0 + W[t-7] + s1;
+         }
+
+      uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+      uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+      for(size_t t = 0; t != 64; ++t)
+         {
+         const uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+         const uint32_t ch = (e & f) ^ (~e & g);
+         const uint32_t T1 = h + S1 + ch + SHA256_K[t] + W[t];
+         const uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+         const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+
+         h = g;
+         g = f;
+         f = e;
+         e = d + T1;
+         d = c;
+         c = b;
+         b = a;
+         a = T1 + S0 + maj;
+         }
+
+      state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+      state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+      }
+   }
+
+#if defined(FECPP_IS_X86)
+
+/*
+* Run a multi-buffer engine of width lanes on count <= width messages;
+* the spare lanes hash a copy of the first message into scratch states
+*/
+template<size_t width>
+void sha256_compress_simd(void (*engine)(uint32_t* const[], const uint8_t* const[], size_t),
+                          uint32_t* const state[], const uint8_t* const data[],
+                          size_t count, size_t blocks)
+   {
+   uint32_t scratch[width][8];
+   uint32_t* s[width];
+   const uint8_t* d[width];
+
+   for(size_t i = 0; i != width; ++i)
+      {
+      s[i] = (i < count) ? state[i] : scratch[i];
+      d[i] = (i < count) ? data[i] : data[0];
+      }
+
+   engine(s, d, blocks);
+   }
+
+#endif
+
+/*
+* Process blocks 64 byte blocks of each of lanes messages at once,
+* using the widest multi-buffer engine available
+*/
+void sha256_compress_lanes(uint32_t* const state[], const uint8_t* const data[],
+                           size_t lanes, size_t blocks)
+   {
+   size_t done = 0;
+
+#if defined(FECPP_IS_X86)
+   static const bool use_avx2 = has_avx2();
+
+   while(use_avx2 && lanes - done > 4)
+      {
+      const size_t count = std::min<size_t>(8, lanes - done);
+      sha256_compress_simd<8>(sha256_x8_avx2, state + done, data + done,
+                              count, blocks);
+      done += count;
+      }
+
+   while(lanes - done > 1 && has_sse2())
+      {
+      const size_t count = std::min<size_t>(4, lanes - done);
+      sha256_compress_simd<4>(sha256_x4_sse2, state + done, data + done,
+                              count, blocks);
+      done += count;
+      }
+#endif
+
+   for(size_t i = done; i != lanes; ++i)
+      sha256_compress(state[i], data[i], blocks);
+   }
+
+void sha256_final(uint32_t state[8], const uint8_t tail[], size_t tail_len,
+                  uint64_t total, uint8_t out[32])
+   {
+   uint8_t last[128] = { 0 };
+   std::memcpy(last, tail, tail_len);
+   last[tail_len] = 0x80;
+
+   const size_t blocks = (tail_len + 9 <= 64) ? 1 : 2;
+   const uint64_t bits = total * 8;
+   for(size_t i = 0; i != 8; ++i)
+      last[64*blocks - 1 - i] = static_cast<uint8_t>(bits >> (8*i));
+
+   sha256_compress(state, last, blocks);
+
+   for(size_t i = 0; i != 8; ++i)
+      {
+      out[4*i] = static_cast<uint8_t>(state[i] >> 24);
+      out[4*i+1] = static_cast<uint8_t>(state[i] >> 16);
+      out[4*i+2] = static_cast<uint8_t>(state[i] >> 8);
+      out[4*i+3] = static_cast<uint8_t>(state[i]);
+      }
+   }
+
+}
+
+/*
+* One-shot SHA-256
+*/
+std::vector<uint8_t> sha256(const uint8_t data[], size_t len)
+   {
+   uint32_t state[8];
+   std::memcpy(state, SHA256_IV, sizeof(state));
+
+   sha256_compress(state, data, len / 64);
+
+   std::vector<uint8_t> out(32);
+   sha256_final(state, data + (len - len % 64), len % 64, len, &out[0]);
+   return out;
+   }
+
+/*
+* share_hasher constructor
+*/
+share_hasher::share_hasher(size_t n) :
+   states(8*n), buffers(64*n), total(n), hashes(), finished(false)
+   {
+   for(size_t i = 0; i != n; ++i)
+      std::memcpy(&states[8*i], SHA256_IV, sizeof(SHA256_IV));
+   }
+
+/*
+* Add the next len bytes of each share
+*/
+void share_hasher::update(const uint8_t* const shares[], size_t len)
+   {
+   if(finished)
+      throw std::logic_error("share_hasher: update after finish");
+
+   std::vector<uint32_t*> lane_state;
+   std::vector<const uint8_t*> lane_data;
+   std::vector<size_t> lane_blocks;
+
+   for(size_t i = 0; i != total.size(); ++i)
+      {
+      if(shares[i] == 0)
+         continue;
+
+      const uint8_t* data = shares[i];
+      size_t left = len;
+
+      const size_t buffered = total[i] % 64;
+      total[i] += len;
+
+      // first complete any partial block left by the previous update
+      if(buffered)
+         {
+         const size_t take = std::min(64 - buffered, left);
+         std::memcpy(&buffers[64*i + buffered], data, take);
+         data += take;
+         left -= take;
+
+         if(buffered + take < 64)
+            continue;
+
+         sha256_compress(&states[8*i], &buffers[64*i], 1);
+         }
+
+      std::memcpy(&buffers[64*i], data + (left - left % 64), left % 64);
+
+      if(left >= 64)
+         {
+         lane_state.push_back(&states[8*i]);
+         lane_data.push_back(data);
+         lane_blocks.push_back(left / 64);
+         }
+      }
+
+   /*
+   Hash the whole blocks of up to 8 shares at a time. When the shares
+   are updated in step, they all have the same number of blocks.
+   */
+   for(size_t first = 0; first < lane_state.size(); first += 8)
+      {
+      const size_t lanes = std::min<size_t>(8, lane_state.size() - first);
+
+      const size_t blocks = *std::min_element(lane_blocks.begin() + first,
+                                              lane_blocks.begin() + first + lanes);
+
+      sha256_compress_lanes(&lane_state[first], &lane_data[first], lanes, blocks);
+
+      for(size_t i = first; i != first + lanes; ++i)
+         if(lane_blocks[i] > blocks)
+            sha256_compress(lane_state[i], lane_data[i] + 64*blocks,
+                            lane_blocks[i] - blocks);
+      }
+   }
+
+/*
+* Add the next len bytes of share i only
+*/
+void share_hasher::update(size_t i, const uint8_t data[], size_t len)
+   {
+   if(i >= total.size())
+      throw std::invalid_argument("share_hasher: invalid share id");
+
+   std::vector<const uint8_t*> shares(total.size());
+   shares[i] = data;
+   update(&shares[0], len);
+   }
+
+/*
+* Complete the hashes
+*/
+void share_hasher::finish()
+   {
+   if(finished)
+      return;
+
+   hashes.resize(32 * total.size());
+
+   for(size_t i = 0; i != total.size(); ++i)
+      sha256_final(&states[8*i], &buffers[64*i], total[i] % 64, total[i],
+                   &hashes[32*i]);
+
+   finished = true;
+   }
+
+/*
+* Return the hash of share i
+*/
+std::vector<uint8_t> share_hasher::hash(size_t i) const
+   {
+   if(!finished)
+      throw std::logic_error("share_hasher: hash before finish");
+   if(i >= total.size())
+      throw std::invalid_argument("share_hasher: invalid share id");
+
+   return std::vector<uint8_t>(&hashes[32*i], &hashes[32*i] + 32);
+   }
+
+/*
+* Return H(H_1 || ... || H_n)
+*/
+std::vector<uint8_t> share_hasher::top_hash() const
+   {
+   if(!finished)
+      throw std::logic_error("share_hasher: top_hash before finish");
+
+   return sha256(hashes.data(), hashes.size());
+   }
+
+}
@@ -0,0 +1,70 @@
+/*
+ * 16 byte vectors of GF(2^8) elements, using GCC/Clang vector
+ * extensions; shared by fecpp_fixed.h and fecpp_generic.cpp
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#ifndef FECPP_SIMD_H_
+#define FECPP_SIMD_H_
+
+#include "fecpp.h"
+
+#if defined(FECPP_IS_X86)
+  #include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  #include <arm_neon.h>
+#endif
+
+namespace fecpp {
+
+namespace simd {
+
+typedef uint8_t vec16 __attribute__((vector_size(16)));
+typedef int8_t svec16 __attribute__((vector_size(16)));
+
+/*
+* Multiply each byte by x
+*/
+inline vec16 xtime(vec16 v)
+   {
+   const vec16 carry = (vec16)((svec16)v >> 7);
+   return (v + v) ^ (carry & 0x1D);
+   }
+
+/*
+* Look up each byte of idx, all less than 16, in table. This is only
+* defined, along with FECPP_SIMD_SHUFFLE, where there is an instruction
+* for it; on x86 it is SSSE3's pshufb, so callers must only use it when
+* SSSE3 is enabled or has been checked for. __builtin_shuffle is GCC
+* only, so it is just used for 32-bit NEON.
+*/
+#if defined(FECPP_IS_X86)
+   #define FECPP_SIMD_SHUFFLE
+
+   __attribute__((target("ssse3")))
+   inline vec16 shuffle(vec16 table, vec16 idx)
+      {
+      return (vec16)_mm_shuffle_epi8((__m128i)table, (__m128i)idx);
+      }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+   #define FECPP_SIMD_SHUFFLE
+
+   inline vec16 shuffle(vec16 table, vec16 idx)
+      {
+      return (vec16)vqtbl1q_u8((uint8x16_t)table, (uint8x16_t)idx);
+      }
+#elif defined(__ARM_NEON) && defined(__GNUC__) && !defined(__clang__)
+   #define FECPP_SIMD_SHUFFLE
+
+   inline vec16 shuffle(vec16 table, vec16 idx)
+      {
+      return __builtin_shuffle(table, idx);
+      }
+#endif
+
+}
+
+}
+
+#endif
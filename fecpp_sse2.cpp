@@ -5,7 +5,11 @@
  */
 
 #include "fecpp.h"
+
+#if defined(FECPP_IS_X86)
+
 #include <emmintrin.h>
+#include <cstring>
 
 namespace fecpp {
 
@@ -97,4 +101,142 @@ size_t addmul_sse2(uint8_t z[], const uint8_t x[], uint8_t y, size_t size)
    return size;
    }
 
+/*
+* Check if the first size - size % 16 bytes of buf are all zero; the
+* caller checks the remainder
+*/
+bool is_zero_sse2(const uint8_t buf[], size_t size)
+   {
+   const __m128i zero = _mm_setzero_si128();
+
+   // check one cache line at a time, stopping at the first nonzero one
+   while(size >= 64)
+      {
+      __m128i x_1 = _mm_loadu_si128((const __m128i*)(buf));
+      __m128i x_2 = _mm_loadu_si128((const __m128i*)(buf + 16));
+      __m128i x_3 = _mm_loadu_si128((const __m128i*)(buf + 32));
+      __m128i x_4 = _mm_loadu_si128((const __m128i*)(buf + 48));
+
+      x_1 = _mm_or_si128(_mm_or_si128(x_1, x_2), _mm_or_si128(x_3, x_4));
+
+      if(_mm_movemask_epi8(_mm_cmpeq_epi8(x_1, zero)) != 0xFFFF)
+         return false;
+
+      buf += 64;
+      size -= 64;
+      }
+
+   while(size >= 16)
+      {
+      __m128i x_1 = _mm_loadu_si128((const __m128i*)(buf));
+
+      if(_mm_movemask_epi8(_mm_cmpeq_epi8(x_1, zero)) != 0xFFFF)
+         return false;
+
+      buf += 16;
+      size -= 16;
+      }
+
+   return true;
+   }
+
+namespace {
+
+inline uint32_t sha256_word(const uint8_t p[])
+   {
+   uint32_t w;
+   std::memcpy(&w, p, 4);
+   return __builtin_bswap32(w);
+   }
+
+}
+
+#define ROTR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+
+/*
+* SHA-256 compression of four messages at once, one in each 32-bit lane
+*/
+void sha256_x4_sse2(uint32_t* const state[], const uint8_t* const data[],
+                    size_t blocks)
+   {
+   __m128i s[8];
+   for(size_t j = 0; j != 8; ++j)
+      s[j] = _mm_set_epi32(state[3][j], state[2][j], state[1][j],
+                           state[0][j]);
+
+   __m128i W[64];
+
+   for(size_t i = 0; i != blocks; ++i)
+      {
+      for(size_t t = 0; t != 16; ++t)
+         {
+         const size_t off = 64*i + 4*t;
+         W[t] = _mm_set_epi32(sha256_word(data[3] + off),
+                              sha256_word(data[2] + off),
+                              sha256_word(data[1] + off),
+                              sha256_word(data[0] + off));
+         }
+
+      for(size_t t = 16; t != 64; ++t)
+         {
+         const __m128i s0 = _mm_xor_si128(
+            _mm_xor_si128(ROTR(W[t-15], 7), ROTR(W[t-15], 18)),
+            _mm_srli_epi32(W[t-15], 3));
+         const __m128i s1 = _mm_xor_si128(
+            _mm_xor_si128(ROTR(W[t-2], 17), ROTR(W[t-2], 19)),
+            _mm_srli_epi32(W[t-2], 10));
+         W[t] = _mm_add_epi32(_mm_add_epi32(W[t-16], s0),
+                             _mm_add_epi32(W[t-7], s1));
+         }
+
+      __m128i a = s[0], b = s[1], c = s[2], d = s[3];
+      __m128i e = s[4], f = s[5], g = s[6], h = s[7];
+
+      for(size_t t = 0; t != 64; ++t)
+         {
+         const __m128i S1 = _mm_xor_si128(
+            _mm_xor_si128(ROTR(e, 6), ROTR(e, 11)), ROTR(e, 25));
+         const __m128i ch = _mm_xor_si128(_mm_and_si128(e, f),
+                                         _mm_andnot_si128(e, g));
+         const __m128i T1 = _mm_add_epi32(
+            _mm_add_epi32(_mm_add_epi32(h, S1), _mm_add_epi32(ch, W[t])),
+            _mm_set1_epi32(SHA256_K[t]));
+         const __m128i S0 = _mm_xor_si128(
+            _mm_xor_si128(ROTR(a, 2), ROTR(a, 13)), ROTR(a, 22));
+         const __m128i maj = _mm_or_si128(_mm_and_si128(a, b),
+                                        _mm_and_si128(c, _mm_or_si128(a, b)));
+
+         h = g;
+         g = f;
+         f = e;
+         e = _mm_add_epi32(d, T1);
+         d = c;
+         c = b;
+         b = a;
+         a = _mm_add_epi32(T1, _mm_add_epi32(S0, maj));
+         }
+
+      s[0] = _mm_add_epi32(s[0], a);
+      s[1] = _mm_add_epi32(s[1], b);
+      s[2] = _mm_add_epi32(s[2], c);
+      s[3] = _mm_add_epi32(s[3], d);
+      s[4] = _mm_add_epi32(s[4], e);
+      s[5] = _mm_add_epi32(s[5], f);
+      s[6] = _mm_add_epi32(s[6], g);
+      s[7] = _mm_add_epi32(s[7], h);
+      }
+
+   for(size_t j = 0; j != 8; ++j)
+      {
+      uint32_t lanes[4];
+      _mm_storeu_si128((__m128i*)lanes, s[j]);
+      for(size_t l = 0; l != 4; ++l)
+         state[l][j] = lanes[l];
+      }
+   }
+
+#undef ROTR
+
 }
+
+#endif
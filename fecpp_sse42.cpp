@@ -0,0 +1,189 @@
+/*
+ * SSE4.2 routines: CRC32C
+ *
+ * Distributed under the terms given in license.txt (Simplified BSD)
+ */
+
+#include "fecpp.h"
+
+#if defined(FECPP_IS_X86)
+
+#include <nmmintrin.h>
+#include <cstring>
+
+namespace fecpp {
+
+namespace {
+
+/*
+* The crc32 instruction has a latency of 3 cycles but a throughput of
+* one per cycle, so long inputs are processed as three interleaved
+* streams. Each stream starts from a zero CRC, and they are combined
+* by shifting a CRC over the length of the streams that follow it,
+* which is a linear map applied a byte at a time from these tables.
+*/
+const size_t LONG = 1024;
+const size_t SHORT = 128;
+
+uint32_t CRC32C_LONG[4][256];
+uint32_t CRC32C_SHORT[4][256];
+
+uint32_t gf2_matrix_times(const uint32_t mat[32], uint32_t vec)
+   {
+   uint32_t sum = 0;
+   for(size_t i = 0; vec; ++i, vec >>= 1)
+      if(vec & 1)
+         sum ^= mat[i];
+   return sum;
+   }
+
+void gf2_matrix_square(uint32_t square[32], const uint32_t mat[32])
+   {
+   for(size_t i = 0; i != 32; ++i)
+      square[i] = gf2_matrix_times(mat, mat[i]);
+   }
+
+/*
+* Build the tables for shifting a CRC over len zero bytes
+*/
+void build_shift_table(uint32_t table[4][256], size_t len)
+   {
+   uint32_t op[32], sq[32], tmp[32];
+
+   // the operator for one zero bit
+   op[0] = 0x82F63B78;
+   for(size_t i = 1; i != 32; ++i)
+      op[i] = 1 << (i - 1);
+
+   // square up to one zero byte
+   for(size_t i = 0; i != 3; ++i)
+      {
+      gf2_matrix_square(tmp, op);
+      std::memcpy(op, tmp, sizeof(op));
+      }
+
+   // now op shifts over 2^k zero bytes; multiply in those set in len
+   uint32_t result[32];
+   for(size_t i = 0; i != 32; ++i)
+      result[i] = 1 << i;
+
+   while(len)
+      {
+      if(len & 1)
+         {
+         for(size_t i = 0; i != 32; ++i)
+            tmp[i] = gf2_matrix_times(op, result[i]);
+         std::memcpy(result, tmp, sizeof(result));
+         }
+
+      gf2_matrix_square(sq, op);
+      std::memcpy(op, sq, sizeof(op));
+      len >>= 1;
+      }
+
+   for(size_t k = 0; k != 4; ++k)
+      for(size_t n = 0; n != 256; ++n)
+         table[k][n] = gf2_matrix_times(result, n << (8*k));
+   }
+
+bool build_shift_tables()
+   {
+   build_shift_table(CRC32C_LONG, LONG);
+   build_shift_table(CRC32C_SHORT, SHORT);
+   return true;
+   }
+
+inline uint32_t crc32c_shift(const uint32_t table[4][256], uint32_t crc)
+   {
+   return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^
+          table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+   }
+
+#if defined(__x86_64__)
+
+typedef uint64_t crc_word;
+
+inline crc_word crc32c_word(crc_word crc, const uint8_t p[])
+   {
+   uint64_t w;
+   std::memcpy(&w, p, 8);
+   return _mm_crc32_u64(crc, w);
+   }
+
+#else
+
+typedef uint32_t crc_word;
+
+inline crc_word crc32c_word(crc_word crc, const uint8_t p[])
+   {
+   uint32_t w;
+   std::memcpy(&w, p, 4);
+   return _mm_crc32_u32(crc, w);
+   }
+
+#endif
+
+/*
+* Process three streams of len bytes each, starting at p
+*/
+inline uint32_t crc32c_3way(uint32_t crc, const uint8_t p[], size_t len,
+                            const uint32_t shift[4][256])
+   {
+   crc_word crc0 = crc, crc1 = 0, crc2 = 0;
+
+   for(size_t i = 0; i != len; i += sizeof(crc_word))
+      {
+      crc0 = crc32c_word(crc0, p + i);
+      crc1 = crc32c_word(crc1, p + len + i);
+      crc2 = crc32c_word(crc2, p + 2*len + i);
+      }
+
+   crc = crc32c_shift(shift, crc0) ^ crc1;
+   return crc32c_shift(shift, crc) ^ crc2;
+   }
+
+}
+
+/*
+* Update a raw (not inverted) CRC32C state using the crc32 instruction
+*/
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t buf[], size_t len)
+   {
+   static const bool tables_built = build_shift_tables();
+   (void)tables_built;
+
+   while(len >= 3*LONG)
+      {
+      crc = crc32c_3way(crc, buf, LONG, CRC32C_LONG);
+      buf += 3*LONG;
+      len -= 3*LONG;
+      }
+
+   while(len >= 3*SHORT)
+      {
+      crc = crc32c_3way(crc, buf, SHORT, CRC32C_SHORT);
+      buf += 3*SHORT;
+      len -= 3*SHORT;
+      }
+
+   crc_word crc0 = crc;
+   while(len >= sizeof(crc_word))
+      {
+      crc0 = crc32c_word(crc0, buf);
+      buf += sizeof(crc_word);
+      len -= sizeof(crc_word);
+      }
+   crc = crc0;
+
+   while(len)
+      {
+      crc = _mm_crc32_u8(crc, *buf++);
+      --len;
+      }
+
+   return crc;
+   }
+
+}
+
+#endif
@@ -5,6 +5,9 @@
  */
 
 #include "fecpp.h"
+
+#if defined(FECPP_IS_X86)
+
 #include <tmmintrin.h>
 
 namespace fecpp {
@@ -568,5 +571,124 @@ size_t addmul_ssse3(uint8_t z[], const uint8_t x[], uint8_t y, size_t size)
    return size;
    }
 
+/*
+* addmul over the 16 bytes at z, changing only bytes first...last-1;
+* used for the unaligned ends of a larger buffer
+*/
+void addmul_ssse3_window(uint8_t z[], const uint8_t x[], uint8_t y,
+                         size_t first, size_t last)
+   {
+   const __m128i mask = _mm_set1_epi8(0x0f);
+   const __m128i t_lo = _mm_load_si128((const __m128i*)(GFTBL + 32*y));
+   const __m128i t_hi = _mm_load_si128((const __m128i*)(GFTBL + 32*y + 16));
+
+   const __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15);
+   const __m128i keep = _mm_and_si128(
+      _mm_cmpgt_epi8(index, _mm_set1_epi8(static_cast<char>(first) - 1)),
+      _mm_cmplt_epi8(index, _mm_set1_epi8(static_cast<char>(last))));
+
+   const __m128i x_1 = _mm_loadu_si128((const __m128i*)(x));
+   const __m128i z_1 = _mm_loadu_si128((const __m128i*)(z));
+
+   const __m128i x_lo = _mm_and_si128(x_1, mask);
+   const __m128i x_hi = _mm_and_si128(_mm_srli_epi64(x_1, 4), mask);
+
+   const __m128i r = _mm_xor_si128(_mm_shuffle_epi8(t_lo, x_lo),
+                                   _mm_shuffle_epi8(t_hi, x_hi));
+
+   _mm_storeu_si128((__m128i*)(z), _mm_xor_si128(z_1, _mm_and_si128(r, keep)));
+   }
+
+/*
+* Compare p[] against the sum of x[j][] * y[j] for j < n without
+* storing the sum. Returns how many leading bytes (a multiple of 16)
+* were found to match before a 16 byte group that differs, or before
+* fewer than 16 bytes remain.
+*/
+size_t dot_compare_ssse3(const uint8_t p[], const uint8_t* const x[],
+                         const uint8_t y[], size_t n, size_t size)
+   {
+   const __m128i mask = _mm_set1_epi8(0x0f);
+
+   size_t done = 0;
+
+   // unrolled out to cache line size
+   while(size - done >= 64)
+      {
+      __m128i s_1 = _mm_setzero_si128();
+      __m128i s_2 = _mm_setzero_si128();
+      __m128i s_3 = _mm_setzero_si128();
+      __m128i s_4 = _mm_setzero_si128();
+
+      for(size_t j = 0; j != n; ++j)
+         {
+         const __m128i t_lo = _mm_load_si128((const __m128i*)(GFTBL + 32*y[j]));
+         const __m128i t_hi = _mm_load_si128((const __m128i*)(GFTBL + 32*y[j] + 16));
+
+         const uint8_t* xj = x[j] + done;
+
+         const __m128i x_1 = _mm_loadu_si128((const __m128i*)(xj));
+         const __m128i x_2 = _mm_loadu_si128((const __m128i*)(xj + 16));
+         const __m128i x_3 = _mm_loadu_si128((const __m128i*)(xj + 32));
+         const __m128i x_4 = _mm_loadu_si128((const __m128i*)(xj + 48));
+
+         s_1 = _mm_xor_si128(s_1, _mm_xor_si128(
+                  _mm_shuffle_epi8(t_lo, _mm_and_si128(x_1, mask)),
+                  _mm_shuffle_epi8(t_hi, _mm_and_si128(_mm_srli_epi64(x_1, 4), mask))));
+         s_2 = _mm_xor_si128(s_2, _mm_xor_si128(
+                  _mm_shuffle_epi8(t_lo, _mm_and_si128(x_2, mask)),
+                  _mm_shuffle_epi8(t_hi, _mm_and_si128(_mm_srli_epi64(x_2, 4), mask))));
+         s_3 = _mm_xor_si128(s_3, _mm_xor_si128(
+                  _mm_shuffle_epi8(t_lo, _mm_and_si128(x_3, mask)),
+                  _mm_shuffle_epi8(t_hi, _mm_and_si128(_mm_srli_epi64(x_3, 4), mask))));
+         s_4 = _mm_xor_si128(s_4, _mm_xor_si128(
+                  _mm_shuffle_epi8(t_lo, _mm_and_si128(x_4, mask)),
+                  _mm_shuffle_epi8(t_hi, _mm_and_si128(_mm_srli_epi64(x_4, 4), mask))));
+         }
+
+      // non-zero bytes where the sum and p differ
+      s_1 = _mm_xor_si128(s_1, _mm_loadu_si128((const __m128i*)(p + done)));
+      s_2 = _mm_xor_si128(s_2, _mm_loadu_si128((const __m128i*)(p + done + 16)));
+      s_3 = _mm_xor_si128(s_3, _mm_loadu_si128((const __m128i*)(p + done + 32)));
+      s_4 = _mm_xor_si128(s_4, _mm_loadu_si128((const __m128i*)(p + done + 48)));
+
+      const __m128i diff = _mm_or_si128(_mm_or_si128(s_1, s_2),
+                                        _mm_or_si128(s_3, s_4));
+
+      if(_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF)
+         break;
+
+      done += 64;
+      }
+
+   while(size - done >= 16)
+      {
+      __m128i s_1 = _mm_setzero_si128();
+
+      for(size_t j = 0; j != n; ++j)
+         {
+         const __m128i t_lo = _mm_load_si128((const __m128i*)(GFTBL + 32*y[j]));
+         const __m128i t_hi = _mm_load_si128((const __m128i*)(GFTBL + 32*y[j] + 16));
+
+         const __m128i x_1 = _mm_loadu_si128((const __m128i*)(x[j] + done));
+
+         s_1 = _mm_xor_si128(s_1, _mm_xor_si128(
+                  _mm_shuffle_epi8(t_lo, _mm_and_si128(x_1, mask)),
+                  _mm_shuffle_epi8(t_hi, _mm_and_si128(_mm_srli_epi64(x_1, 4), mask))));
+         }
+
+      const __m128i p_1 = _mm_loadu_si128((const __m128i*)(p + done));
+
+      if(_mm_movemask_epi8(_mm_cmpeq_epi8(s_1, p_1)) != 0xFFFF)
+         break;
+
+      done += 16;
+      }
+
+   return done;
+   }
+
 }
 
+#endif
@@ -0,0 +1,1438 @@
+#include "fecpp.h"
+#include "fecpp_fixed.h"
+#include "fecpp_c.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <random>
+
+using fecpp::byte;
+
+namespace {
+
+int failures = 0;
+
+std::minstd_rand rng;
+
+void check(bool ok, const char* what, size_t k, size_t n)
+   {
+   if(!ok)
+      {
+      printf("FAILED: %s k=%d n=%d\n", what, (int)k, (int)n);
+      ++failures;
+      }
+   }
+
+std::vector<byte> random_input(size_t size)
+   {
+   std::vector<byte> input(size);
+   for(size_t i = 0; i != input.size(); ++i)
+      input[i] = rand();
+   return input;
+   }
+
+std::vector<std::vector<byte> > encode_all(const fecpp::fec_code& code,
+                                           const std::vector<byte>& input)
+   {
+   std::vector<std::vector<byte> > shares(code.get_N());
+
+   code.encode(&input[0], input.size(),
+               [&](size_t i, size_t, const byte share[], size_t len)
+                  { shares[i].assign(share, share + len); });
+
+   return shares;
+   }
+
+/*
+* Multiplication in GF(2^8), bit at a time
+*/
+byte gf_mul(byte a, byte b)
+   {
+   byte r = 0;
+   for(; b; b >>= 1)
+      {
+      if(b & 1)
+         r ^= a;
+      a = (a << 1) ^ ((a & 0x80) ? 0x1D : 0);
+      }
+   return r;
+   }
+
+/*
+* Drop shares at random until only k remain
+*/
+std::map<size_t, const byte*>
+choose_k(const std::vector<std::vector<byte> >& shares, size_t k)
+   {
+   std::map<size_t, const byte*> m;
+   for(size_t i = 0; i != shares.size(); ++i)
+      m[i] = &shares[i][0];
+
+   while(m.size() > k)
+      m.erase(rand() % shares.size());
+
+   return m;
+   }
+
+void test_decode_range(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1024;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+   std::map<size_t, const byte*> chosen = choose_k(shares, k);
+
+   const size_t offset = rand() % share_size;
+   const size_t length = rand() % (share_size - offset + 1);
+
+   std::vector<size_t> blocks;
+   for(size_t i = 0; i != k; ++i)
+      if(rand() % 2)
+         blocks.push_back(i);
+
+   size_t seen = 0;
+   code.decode_range(chosen, share_size, offset, length, blocks,
+                     [&](size_t block, size_t, const byte buf[], size_t len)
+      {
+      ++seen;
+      // buf may be null if len is 0
+      check(len == length &&
+            (len == 0 ||
+             memcmp(buf, &input[block*share_size + offset], len) == 0),
+            "decode_range output", k, n);
+      });
+
+   check(seen == blocks.size(), "decode_range block count", k, n);
+
+   bool threw = false;
+   try
+      {
+      code.decode_range(chosen, share_size, offset, share_size - offset + 1,
+                        blocks,
+                        [](size_t, size_t, const byte[], size_t) {});
+      }
+   catch(std::invalid_argument&)
+      {
+      threw = true;
+      }
+   check(threw, "decode_range past the end of the shares", k, n);
+   }
+
+void test_update_parity(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 512;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+
+   // overwrite a random range of one data block
+   const size_t block = rand() % k;
+   const size_t offset = rand() % share_size;
+   const size_t length = rand() % (share_size - offset + 1);
+
+   std::vector<byte> old_data(&input[block*share_size + offset],
+                              &input[block*share_size + offset] + length);
+   for(size_t i = 0; i != length; ++i)
+      input[block*share_size + offset + i] = rand();
+
+   std::vector<byte*> parity;
+   for(size_t i = k; i != n; ++i)
+      parity.push_back(&shares[i][offset]);
+
+   code.update_parity(block, old_data.data(),
+                      &input[block*share_size + offset], length,
+                      parity.data());
+
+   std::vector<std::vector<byte> > expected = encode_all(code, input);
+   for(size_t i = k; i != n; ++i)
+      check(shares[i] == expected[i], "update_parity", k, n);
+   }
+
+void test_fec_encoder(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t block_size = 1 + rand() % 300;
+   std::vector<byte> input = random_input(rand() % (3 * k * block_size));
+
+   std::vector<std::vector<byte> > streamed(n);
+
+   fecpp::fec_encoder encoder(code, block_size,
+      [&](size_t i, size_t, const byte share[], size_t len)
+         { streamed[i].insert(streamed[i].end(), share, share + len); });
+
+   for(size_t pos = 0; pos != input.size(); )
+      {
+      const size_t take = std::min<size_t>(input.size() - pos, rand() % 700);
+      encoder.update(&input[pos], take);
+      pos += take;
+      }
+   encoder.finish();
+
+   // Compare against encoding each zero padded stripe in one go
+   const size_t stripe = k * block_size;
+   std::vector<byte> padded = input;
+   padded.resize((input.size() + stripe - 1) / stripe * stripe);
+
+   std::vector<std::vector<byte> > expected(n);
+   for(size_t pos = 0; pos != padded.size(); pos += stripe)
+      code.encode(&padded[pos], stripe,
+                  [&](size_t i, size_t, const byte share[], size_t len)
+                     { expected[i].insert(expected[i].end(), share, share + len); });
+
+   check(streamed == expected, "fec_encoder", k, n);
+   }
+
+void test_fec_decoder(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1 + rand() % 600;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+
+   std::vector<size_t> order;
+   for(size_t i = 0; i != n; ++i)
+      order.push_back(i);
+   std::shuffle(order.begin(), order.end(), rng);
+
+   std::vector<size_t> outputs(k);
+
+   fecpp::fec_decoder decoder(code, share_size,
+      [&](size_t block, size_t, const byte buf[], size_t len)
+      {
+      ++outputs[block];
+      check(len == share_size &&
+            memcmp(buf, &input[block*share_size], len) == 0,
+            "fec_decoder output", k, n);
+      });
+
+   size_t used = 0;
+   for(size_t i = 0; i != n && !decoder.complete(); ++i)
+      {
+      // duplicates carry no new information
+      used += decoder.add_share(order[i], &shares[order[i]][0]);
+      check(!decoder.add_share(order[i], &shares[order[i]][0]),
+            "fec_decoder duplicate", k, n);
+      }
+
+   check(decoder.complete() && used == k, "fec_decoder complete", k, n);
+   for(size_t i = 0; i != k; ++i)
+      check(outputs[i] == 1, "fec_decoder output count", k, n);
+   }
+
+void test_fec_stream_decoder(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1 + rand() % 600;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+   std::map<size_t, const byte*> chosen = choose_k(shares, k);
+
+   std::vector<size_t> ids;
+   for(auto i = chosen.begin(); i != chosen.end(); ++i)
+      ids.push_back(i->first);
+
+   std::vector<std::vector<byte> > output(k);
+
+   fecpp::fec_stream_decoder decoder(code, ids, share_size,
+      [&](size_t block, size_t, const byte buf[], size_t len)
+         { output[block].insert(output[block].end(), buf, buf + len); });
+
+   // deliver each share in pieces, interleaved and out of order
+   std::vector<std::pair<size_t, size_t> > pieces;
+   for(size_t i = 0; i != ids.size(); ++i)
+      for(size_t pos = 0; pos < share_size; pos += 64)
+         pieces.push_back(std::make_pair(ids[i], pos));
+   std::shuffle(pieces.begin(), pieces.end(), rng);
+
+   for(size_t i = 0; i != pieces.size(); ++i)
+      {
+      const size_t id = pieces[i].first;
+      const size_t pos = pieces[i].second;
+      const size_t len = std::min<size_t>(64, share_size - pos);
+      decoder.add(id, pos, &shares[id][pos], len);
+      }
+
+   check(decoder.complete(), "fec_stream_decoder complete", k, n);
+   for(size_t i = 0; i != k; ++i)
+      check(output[i] == std::vector<byte>(&input[i*share_size],
+                                           &input[(i+1)*share_size]),
+            "fec_stream_decoder output", k, n);
+   }
+
+void test_share_generator(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   std::vector<byte> input = random_input(k * (1 + rand() % 300));
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+
+   fecpp::fec_share_generator gen(code, &input[0], input.size());
+
+   // random access first, then the sequential interface
+   const size_t pick = rand() % n;
+   const byte* share = gen.share(pick);
+   check(memcmp(share, &shares[pick][0], gen.share_size()) == 0,
+         "fec_share_generator share", k, n);
+
+   size_t id = 0, len = 0, produced = 0;
+   while(gen.next(id, share, len))
+      {
+      check(id == produced && len == shares[id].size() &&
+            memcmp(share, &shares[id][0], len) == 0,
+            "fec_share_generator next", k, n);
+      ++produced;
+      }
+
+   check(produced == n, "fec_share_generator count", k, n);
+   }
+
+void test_encode_shares(size_t k, size_t n)
+   {
+   const size_t n2 = n + rand() % (257 - n);
+
+   fecpp::fec_code code(k, n);
+   fecpp::fec_code bigger = code.extended(n2);
+
+   std::vector<byte> input = random_input(k * (1 + rand() % 300));
+   std::vector<std::vector<byte> > expected =
+      encode_all(fecpp::fec_code(k, n2), input);
+
+   check(bigger.get_N() == n2 && encode_all(bigger, input) == expected,
+         "fec_code::extended", k, n);
+
+   std::vector<size_t> ids;
+   for(size_t i = 0; i != n2; ++i)
+      if(rand() % 4 == 0)
+         ids.push_back(i);
+
+   size_t seen = 0;
+   bigger.encode_shares(ids, &input[0], input.size(),
+      [&](size_t i, size_t, const byte share[], size_t len)
+      {
+      check(i == ids[seen] && len == expected[i].size() &&
+            memcmp(share, &expected[i][0], len) == 0,
+            "encode_shares", k, n);
+      ++seen;
+      });
+
+   check(seen == ids.size(), "encode_shares count", k, n);
+   }
+
+void test_shared_codes(size_t k, size_t n)
+   {
+   fecpp::fec_code fresh(k, n);
+
+   std::vector<byte> serialized = fresh.serialize();
+   fecpp::fec_code loaded =
+      fecpp::fec_code::deserialize(&serialized[0], serialized.size());
+
+   std::vector<byte> input = random_input(k * 64);
+   check(encode_all(loaded, input) == encode_all(fresh, input),
+         "fec_code::deserialize", k, n);
+
+   // a damaged blob is rejected, wherever the damage is
+   for(size_t i = 0; i != serialized.size(); ++i)
+      {
+      std::vector<byte> bad = serialized;
+      bad[i] ^= 1 << (rand() % 8);
+
+      bool threw = false;
+      try
+         {
+         fecpp::fec_code::deserialize(&bad[0], bad.size());
+         }
+      catch(std::invalid_argument&)
+         {
+         threw = true;
+         }
+      check(threw, "fec_code::deserialize rejects corruption", k, n);
+      }
+
+   // the first instance registered for K and N is the one shared
+   std::shared_ptr<const fecpp::fec_code> registered =
+      std::make_shared<const fecpp::fec_code>(loaded);
+   fecpp::register_fec_code(registered);
+   fecpp::register_fec_code(std::make_shared<const fecpp::fec_code>(fresh));
+
+   std::shared_ptr<const fecpp::fec_code> code = fecpp::shared_fec_code(k, n);
+   check(code == registered, "register_fec_code", k, n);
+   check(code == fecpp::shared_fec_code(k, n), "shared_fec_code", k, n);
+   }
+
+void test_decode_batch(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1 + rand() % 200;
+   const size_t stripes = 1 + rand() % 8;
+
+   std::vector<std::vector<byte> > inputs;
+   std::vector<std::vector<std::vector<byte> > > encoded;
+   for(size_t s = 0; s != stripes; ++s)
+      {
+      inputs.push_back(random_input(k * share_size));
+      encoded.push_back(encode_all(code, inputs[s]));
+      }
+
+   // every stripe is missing the same shares
+   std::map<size_t, const byte*> chosen = choose_k(encoded[0], k);
+   std::vector<size_t> ids;
+   for(auto i = chosen.begin(); i != chosen.end(); ++i)
+      ids.push_back(i->first);
+   std::shuffle(ids.begin(), ids.end(), rng);
+
+   std::vector<const byte*> shares;
+   for(size_t s = 0; s != stripes; ++s)
+      for(size_t i = 0; i != ids.size(); ++i)
+         shares.push_back(&encoded[s][ids[i]][0]);
+
+   for(size_t threads = 1; threads <= 3; threads += 2)
+      {
+      std::vector<std::vector<byte> > output(stripes,
+                                             std::vector<byte>(k * share_size));
+
+      code.decode_batch(ids, shares, share_size,
+         [&](size_t stripe, size_t block, size_t, const byte buf[], size_t len)
+            { memcpy(&output[stripe][block*share_size], buf, len); },
+         threads);
+
+      check(output == inputs, "decode_batch", k, n);
+      }
+   }
+
+void test_verify(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1 + rand() % 700;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+
+   std::vector<const byte*> ptrs;
+   for(size_t i = 0; i != n; ++i)
+      ptrs.push_back(&shares[i][0]);
+
+   check(code.verify(&ptrs[0], share_size).empty(), "verify clean", k, n);
+
+   std::map<size_t, size_t> corrupted;
+   for(size_t i = k; i != n; ++i)
+      {
+      if(rand() % 3)
+         continue;
+
+      const size_t first = rand() % share_size;
+      shares[i][first] ^= 1 + rand() % 255;
+      if(first + 1 < share_size)
+         shares[i][first + 1 + rand() % (share_size - first - 1)] ^= 0x80;
+      corrupted[i] = first;
+      }
+
+   check(code.verify(&ptrs[0], share_size) == corrupted,
+         "verify corrupted", k, n);
+   }
+
+void test_decode_correcting(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1 + rand() % 300;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+   std::map<size_t, const byte*> avail =
+      choose_k(shares, k + rand() % (n - k + 1));
+
+   const size_t max_errors = (avail.size() - k) / 2;
+   std::vector<size_t> corrupted;
+
+   for(auto i = avail.begin(); i != avail.end(); ++i)
+      {
+      if(corrupted.size() == max_errors || rand() % 2)
+         continue;
+
+      std::vector<byte>& share = shares[i->first];
+      const std::vector<byte> original = share;
+      share[rand() % share_size] ^= 1 + rand() % 255;
+      for(size_t j = rand() % 4; j != 0; --j)
+         share[rand() % share_size] ^= rand();
+
+      // the later changes may happen to undo the first
+      if(share != original)
+         corrupted.push_back(i->first);
+      }
+
+   std::vector<byte> output(input.size());
+
+   std::vector<size_t> found =
+      code.decode_correcting(avail, share_size,
+                             [&](size_t block, size_t, const byte buf[], size_t len)
+                                { memcpy(&output[block*share_size], buf, len); });
+
+   check(found == corrupted, "decode_correcting located", k, n);
+   check(output == input, "decode_correcting output", k, n);
+   }
+
+/*
+* Bitwise CRC32C, to check crc32c against
+*/
+uint32_t reference_crc32c(const byte buf[], size_t len)
+   {
+   uint32_t crc = 0xFFFFFFFF;
+   for(size_t i = 0; i != len; ++i)
+      {
+      crc ^= buf[i];
+      for(size_t k = 0; k != 8; ++k)
+         crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+      }
+   return ~crc;
+   }
+
+void test_crc32c()
+   {
+   const byte check_string[] = "123456789";
+   check(fecpp::crc32c(0, check_string, 9) == 0xE3069283, "crc32c check value", 0, 0);
+
+   for(size_t i = 0; i != 200; ++i)
+      {
+      std::vector<byte> buf = random_input(rand() % (i < 100 ? 100 : 20000));
+      const size_t split = rand() % (buf.size() + 1);
+
+      const uint32_t crc = fecpp::crc32c(0, buf.data(), buf.size());
+      const uint32_t crc_split =
+         fecpp::crc32c(fecpp::crc32c(0, buf.data(), split),
+                       buf.data() + split, buf.size() - split);
+
+      check(crc == reference_crc32c(buf.data(), buf.size()), "crc32c", 0, 0);
+      check(crc_split == crc, "crc32c continued", 0, 0);
+      }
+   }
+
+void test_crc32c_codec(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1 + rand() % 10000;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+
+   size_t good = 0;
+   code.encode_crc32c(&input[0], input.size(),
+                      [&](size_t i, size_t, const byte share[], size_t len,
+                          uint32_t crc)
+                         {
+                         if(std::vector<byte>(share, share + len) == shares[i] &&
+                            crc == fecpp::crc32c(0, share, len))
+                            ++good;
+                         });
+   check(good == n, "encode_crc32c", k, n);
+
+   good = 0;
+   code.decode_crc32c(choose_k(shares, k), share_size,
+                      [&](size_t i, size_t, const byte block[], size_t len,
+                          uint32_t crc)
+                         {
+                         if(memcmp(block, &input[i*share_size], len) == 0 &&
+                            crc == fecpp::crc32c(0, &input[i*share_size], len))
+                            ++good;
+                         });
+   check(good == k, "decode_crc32c", k, n);
+   }
+
+std::vector<byte> hex_decode(const char* hex)
+   {
+   std::vector<byte> out;
+   for(size_t i = 0; hex[i] && hex[i+1]; i += 2)
+      {
+      char pair[3] = { hex[i], hex[i+1], 0 };
+      out.push_back(strtol(pair, 0, 16));
+      }
+   return out;
+   }
+
+void test_sha256()
+   {
+   const char* abc = "abc";
+   const char* two_blocks =
+      "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+   check(fecpp::sha256((const byte*)"", 0) ==
+         hex_decode("E3B0C44298FC1C149AFBF4C8996FB92427AE41E4649B934CA495991B7852B855"),
+         "sha256 empty", 0, 0);
+   check(fecpp::sha256((const byte*)abc, 3) ==
+         hex_decode("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD"),
+         "sha256 abc", 0, 0);
+   check(fecpp::sha256((const byte*)two_blocks, strlen(two_blocks)) ==
+         hex_decode("248D6A61D20638B8E5C026930C3E6039A33CE45964FF2167F6ECEDD419DB06C1"),
+         "sha256 two blocks", 0, 0);
+
+   /*
+   Hash shares in random sized pieces, in step or one at a time, with
+   enough shares to use every engine width
+   */
+   for(size_t n = 1; n != 20; ++n)
+      {
+      const size_t share_size = rand() % 3000;
+      std::vector<std::vector<byte> > shares(n);
+      for(size_t i = 0; i != n; ++i)
+         shares[i] = random_input(share_size);
+
+      fecpp::share_hasher hasher(n);
+
+      for(size_t done = 0; done != share_size; )
+         {
+         const size_t len = std::min<size_t>(rand() % 300, share_size - done);
+
+         if(rand() % 4)
+            {
+            std::vector<const byte*> ptrs;
+            for(size_t i = 0; i != n; ++i)
+               ptrs.push_back(shares[i].data() + done);
+            hasher.update(&ptrs[0], len);
+            }
+         else
+            {
+            for(size_t i = 0; i != n; ++i)
+               hasher.update(i, shares[i].data() + done, len);
+            }
+
+         done += len;
+         }
+
+      hasher.finish();
+
+      std::vector<byte> all_hashes;
+      bool ok = true;
+      for(size_t i = 0; i != n; ++i)
+         {
+         std::vector<byte> h = fecpp::sha256(shares[i].data(), share_size);
+         ok = ok && (hasher.hash(i) == h);
+         all_hashes.insert(all_hashes.end(), h.begin(), h.end());
+         }
+
+      check(ok, "share_hasher", 0, n);
+      check(hasher.top_hash() == fecpp::sha256(&all_hashes[0], all_hashes.size()),
+            "share_hasher top hash", 0, n);
+      }
+   }
+
+void test_hashed_codec(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   const size_t share_size = 1 + rand() % 5000;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares = encode_all(code, input);
+
+   fecpp::share_hasher enc_hasher(n);
+   size_t good = 0;
+   code.encode_hashed(&input[0], input.size(), enc_hasher,
+                      [&](size_t i, size_t, const byte share[], size_t len)
+                         {
+                         if(std::vector<byte>(share, share + len) == shares[i])
+                            ++good;
+                         });
+   enc_hasher.finish();
+
+   for(size_t i = 0; i != n; ++i)
+      if(enc_hasher.hash(i) == fecpp::sha256(shares[i].data(), share_size))
+         ++good;
+   check(good == 2*n, "encode_hashed", k, n);
+
+   std::map<size_t, const byte*> chosen = choose_k(shares, k);
+
+   fecpp::share_hasher dec_hasher(n);
+   good = 0;
+   code.decode_hashed(chosen, share_size, dec_hasher,
+                      [&](size_t i, size_t, const byte block[], size_t len)
+                         {
+                         if(memcmp(block, &input[i*share_size], len) == 0)
+                            ++good;
+                         });
+   dec_hasher.finish();
+
+   for(auto i = chosen.begin(); i != chosen.end(); ++i)
+      if(dec_hasher.hash(i->first) == enc_hasher.hash(i->first))
+         ++good;
+   check(good == 2*k, "decode_hashed", k, n);
+   }
+
+void test_is_zero()
+   {
+   for(size_t len = 0; len != 300; ++len)
+      {
+      std::vector<byte> buf(len + 1);
+      const byte* p = &buf[1]; // unaligned
+
+      check(fecpp::is_zero(p, len), "is_zero zero", len, 0);
+
+      if(len)
+         {
+         buf[1 + rand() % len] = 1 + rand() % 255;
+         check(!fecpp::is_zero(p, len), "is_zero nonzero", len, 0);
+         }
+      }
+   }
+
+void test_sparse_encode(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   // zero out random runs, some long enough to cover whole tiles
+   const size_t share_size = 1 + rand() % 20000;
+   std::vector<byte> input = random_input(k * share_size);
+   for(size_t i = 0; i != 2*k; ++i)
+      {
+      const size_t start = rand() % input.size();
+      const size_t len = std::min<size_t>(rand() % 30000, input.size() - start);
+      std::fill(input.begin() + start, input.begin() + start + len, 0);
+      }
+   if(rand() % 2)
+      std::fill(input.begin(), input.end(), 0);
+
+   /*
+   The expected shares, from the parity rows of serialize (after its 7
+   byte header) and the bitwise gf_mul, looked up in a table since
+   there are up to (N-K)*K*share_size products
+   */
+   static std::vector<byte> mul_table;
+   if(mul_table.empty())
+      for(size_t a = 0; a != 256; ++a)
+         for(size_t b = 0; b != 256; ++b)
+            mul_table.push_back(gf_mul(a, b));
+
+   const std::vector<byte> rows = code.serialize();
+
+   std::vector<std::vector<byte> > expected(n);
+   for(size_t i = 0; i != n; ++i)
+      {
+      if(i < k)
+         {
+         expected[i].assign(&input[i*share_size], &input[(i+1)*share_size]);
+         continue;
+         }
+
+      expected[i].resize(share_size);
+      for(size_t j = 0; j != k; ++j)
+         {
+         const byte* mul = &mul_table[256 * rows[7 + (i-k)*k + j]];
+         for(size_t b = 0; b != share_size; ++b)
+            expected[i][b] ^= mul[input[j*share_size + b]];
+         }
+      }
+
+   check(encode_all(code, input) == expected, "sparse encode", k, n);
+
+   size_t good = 0;
+   code.encode_crc32c(&input[0], input.size(),
+                      [&](size_t i, size_t, const byte share[], size_t len, uint32_t)
+                         {
+                         if(std::vector<byte>(share, share + len) == expected[i])
+                            ++good;
+                         });
+   check(good == n, "sparse encode_crc32c", k, n);
+
+   fecpp::share_hasher hasher(n);
+   good = 0;
+   code.encode_hashed(&input[0], input.size(), hasher,
+                      [&](size_t i, size_t, const byte share[], size_t len)
+                         {
+                         if(std::vector<byte>(share, share + len) == expected[i])
+                            ++good;
+                         });
+   check(good == n, "sparse encode_hashed", k, n);
+   }
+
+void test_packets(size_t k, size_t n)
+   {
+   fecpp::fec_code code(k, n);
+
+   std::vector<std::vector<byte> > packets(k);
+   std::vector<const byte*> ptrs;
+   std::vector<size_t> lengths;
+   for(size_t i = 0; i != k; ++i)
+      {
+      packets[i] = random_input(rand() % 1500);
+      ptrs.push_back(packets[i].data());
+      lengths.push_back(packets[i].size());
+      }
+
+   std::vector<std::vector<byte> > shares(n);
+   code.encode_packets(&ptrs[0], &lengths[0],
+                       [&](size_t i, size_t, const byte share[], size_t len)
+                          { shares[i].assign(share, share + len); });
+
+   std::map<size_t, std::pair<const byte*, size_t> > chosen;
+   for(size_t i = 0; i != n; ++i)
+      chosen[i] = std::make_pair(shares[i].data(), shares[i].size());
+   while(chosen.size() > k)
+      chosen.erase(rand() % n);
+
+   size_t good = 0;
+   code.decode_packets(chosen,
+                       [&](size_t i, size_t, const byte packet[], size_t len)
+                          {
+                          if(std::vector<byte>(packet, packet + len) == packets[i])
+                             ++good;
+                          });
+   check(good == k, "decode_packets", k, n);
+   }
+
+void test_window_code()
+   {
+   const size_t windows[] = { 1, 4, 16, 0 };
+
+   for(size_t w = 0; windows[w]; ++w)
+      {
+      const size_t window = windows[w];
+      const size_t packet_size = 1 + rand() % 200;
+      const size_t count = 500;
+
+      std::vector<std::vector<byte> > sources(count);
+      std::vector<int> seen(count);
+      bool ok = true;
+
+      fecpp::fec_window_encoder enc(window, packet_size);
+      fecpp::fec_window_decoder dec(window, packet_size,
+                                    [&](uint64_t seq, const byte packet[], size_t len)
+                                       {
+                                       ok = ok && seq < count && len == packet_size &&
+                                            memcmp(packet, sources[seq].data(), len) == 0;
+                                       ++seen[seq];
+                                       });
+
+      /*
+      Lose 1 in 8 source packets and 1 in 4 repair packets at random,
+      sending a repair packet after every other source
+      */
+      std::vector<byte> repair(packet_size);
+      for(size_t i = 0; i != count; ++i)
+         {
+         sources[i] = random_input(packet_size);
+         check(enc.add_source(sources[i].data()) == i, "window seq", window, 0);
+
+         if(rand() % 8)
+            dec.add_source(i, sources[i].data());
+
+         if(i % 2 == 1 || i == count - 1)
+            {
+            uint64_t first;
+            size_t covered;
+            const uint64_t id = enc.repair(repair.data(), first, covered);
+            if(rand() % 4)
+               dec.add_repair(id, first, covered, repair.data());
+            }
+         }
+
+      size_t output = 0, dups = 0;
+      for(size_t i = 0; i != count; ++i)
+         {
+         output += (seen[i] > 0);
+         dups += (seen[i] > 1);
+         }
+
+      check(ok, "window decode output", window, 0);
+      check(dups == 0, "window decode duplicates", window, 0);
+      // a window of 1 is just repetition; longer windows recover more
+      check(output >= count * (window == 1 ? 85 : 95) / 100,
+            "window decode recovery", window, 0);
+      }
+   }
+
+void test_rlnc()
+   {
+   const size_t Ks[] = { 1, 2, 5, 16, 64, 0 };
+
+   for(size_t k_i = 0; Ks[k_i]; ++k_i)
+      {
+      const size_t k = Ks[k_i];
+      const size_t packet_size = 1 + rand() % 500;
+      std::vector<byte> input = random_input(k * packet_size);
+
+      fecpp::rlnc_encoder enc(k, packet_size, input.data(), 1 + rand());
+
+      // the relay only ever sees half the generation
+      fecpp::rlnc_decoder relay(k, packet_size, nullptr, 1 + rand());
+
+      std::vector<int> seen(k);
+      bool ok = true;
+      fecpp::rlnc_decoder sink(k, packet_size,
+                               [&](size_t i, size_t, const byte packet[], size_t len)
+                                  {
+                                  ok = ok && len == packet_size &&
+                                       memcmp(packet, &input[i*packet_size], len) == 0;
+                                  ++seen[i];
+                                  });
+
+      std::vector<byte> coded(enc.coded_size());
+
+      while(relay.rank() != (k + 1) / 2)
+         {
+         enc.next(coded.data());
+         relay.add(coded.data());
+         }
+
+      // the sink gets the rest directly, but not what the relay has
+      size_t sent = 0;
+      while(sink.rank() < k - (k + 1) / 2)
+         {
+         enc.next(coded.data());
+         sink.add(coded.data());
+         ++sent;
+         }
+
+      while(!sink.complete() && sent < 4*k + 20)
+         {
+         relay.recode(coded.data());
+         sink.add(coded.data());
+         ++sent;
+         }
+
+      check(sink.complete(), "rlnc complete", k, 0);
+      check(ok, "rlnc output", k, 0);
+      check(std::count(seen.begin(), seen.end(), 1) == (int)k, "rlnc output once", k, 0);
+      }
+   }
+
+void test_product_code()
+   {
+   // K_cols, N_cols, K_rows, N_rows
+   const size_t params[][4] = { { 3, 5, 4, 6 }, { 1, 2, 2, 3 },
+                                { 16, 20, 16, 20 }, { 0 } };
+
+   for(size_t p = 0; params[p][0]; ++p)
+      {
+      const size_t kc = params[p][0], nc = params[p][1];
+      const size_t kr = params[p][2], nr = params[p][3];
+
+      fecpp::fec_product_code code(fecpp::fec_code(kc, nc),
+                                   fecpp::fec_code(kr, nr));
+
+      const size_t k = code.get_K(), n = code.get_N();
+      const size_t share_size = 1 + rand() % 100;
+      std::vector<byte> input = random_input(k * share_size);
+
+      std::vector<std::vector<byte> > shares(n);
+      code.encode(input.data(), input.size(),
+                  [&](size_t i, size_t, const byte share[], size_t len)
+                     { shares[i].assign(share, share + len); });
+
+      bool ok = true;
+      for(size_t r = 0; r != kr; ++r)
+         for(size_t c = 0; c != kc; ++c)
+            ok = ok && memcmp(shares[r*nc + c].data(),
+                              &input[(r*kc + c)*share_size], share_size) == 0;
+      check(ok, "product encode systematic", k, n);
+
+      // any pattern this small is always decodable
+      const size_t lost = (nr - kr + 1) * (nc - kc + 1) - 1;
+
+      std::vector<size_t> ids(n);
+      for(size_t i = 0; i != n; ++i)
+         ids[i] = i;
+      std::shuffle(ids.begin(), ids.end(), rng);
+
+      std::map<size_t, const byte*> remaining;
+      for(size_t i = lost; i != n; ++i)
+         remaining[ids[i]] = shares[ids[i]].data();
+
+      std::vector<byte> decoded(input.size());
+      code.decode(remaining, share_size,
+                  [&](size_t i, size_t, const byte block[], size_t len)
+                     { memcpy(&decoded[i*share_size], block, len); });
+      check(decoded == input, "product decode", k, n);
+
+      bool repaired = false;
+      code.repair(ids[0], remaining, share_size,
+                  [&](size_t i, size_t, const byte share[], size_t len)
+                     {
+                     repaired = i == ids[0] && len == share_size &&
+                                memcmp(share, shares[i].data(), len) == 0;
+                     });
+      check(repaired, "product repair", k, n);
+
+      /*
+      Drop data share (0,0) and the last share of row 0, then rebuild
+      each from the rest; the parity share has to be computed from a
+      row missing a data share
+      */
+      std::map<size_t, const byte*> all_but;
+      for(size_t i = 0; i != n; ++i)
+         if(i != 0 && i != nc - 1)
+            all_but[i] = shares[i].data();
+
+      const size_t targets[2] = { 0, nc - 1 };
+      for(size_t t = 0; t != 2; ++t)
+         {
+         repaired = false;
+         code.repair(targets[t], all_but, share_size,
+                     [&](size_t i, size_t, const byte share[], size_t len)
+                        {
+                        repaired = i == targets[t] && len == share_size &&
+                                   memcmp(share, shares[i].data(), len) == 0;
+                        });
+         check(repaired, "product repair in row", k, n);
+         }
+
+      // a whole missing corner of (N-K+1)^2 shares can't be rebuilt
+      std::map<size_t, const byte*> corner;
+      for(size_t i = 0; i != n; ++i)
+         if(i / nc > nr - kr || i % nc > nc - kc)
+            corner[i] = shares[i].data();
+
+      bool threw = false;
+      try
+         {
+         code.decode(corner, share_size,
+                     [](size_t, size_t, const byte[], size_t) {});
+         }
+      catch(std::logic_error&)
+         {
+         threw = true;
+         }
+      check(threw, "product decode too many lost", k, n);
+      }
+   }
+
+void test_interleaver()
+   {
+   // three full groups of 8, and 3 more left for flush
+   const size_t k = 4, n = 6, stripes = 27;
+   fecpp::fec_code code(k, n);
+
+   const size_t depths[] = { 1, 8, 0 };
+
+   for(size_t d_i = 0; depths[d_i]; ++d_i)
+      {
+      const size_t depth = depths[d_i];
+      const size_t block_size = 1 + rand() % 100;
+      std::vector<byte> input = random_input(stripes * k * block_size);
+
+      struct packet { uint64_t stripe; size_t id; std::vector<byte> data; };
+      std::vector<packet> packets;
+
+      fecpp::fec_interleaver enc(code, depth, block_size,
+         [&](uint64_t stripe, size_t id, size_t, const byte share[], size_t len)
+            {
+            packet p = { stripe, id, std::vector<byte>(share, share + len) };
+            packets.push_back(p);
+            });
+
+      // a stripe per call, then the rest at once
+      const size_t stripe_size = k * block_size;
+      for(size_t s = 0; s != 5; ++s)
+         enc.encode(&input[s * stripe_size], stripe_size);
+      enc.encode(&input[5 * stripe_size], input.size() - 5 * stripe_size);
+      enc.flush();
+
+      check(packets.size() == stripes * n, "interleaver packets", k, n);
+
+      bool order = true;
+      for(size_t i = 0; i != 24 * n; ++i)
+         order = order && packets[i].stripe == i / (n * depth) * depth + i % depth &&
+                 packets[i].id == i % (n * depth) / depth;
+      check(order, "interleaver order", k, n);
+
+      std::vector<byte> output(input.size());
+      std::vector<int> seen(stripes * k);
+
+      fecpp::fec_deinterleaver dec(code, depth, block_size,
+         [&](uint64_t stripe, size_t i, size_t, const byte block[], size_t len)
+            {
+            memcpy(&output[(stripe * k + i) * block_size], block, len);
+            ++seen[stripe * k + i];
+            });
+
+      // an 8 packet burst is survivable only when spread over 8 stripes
+      const size_t burst = 8 * (n - k);
+      const size_t start = rand() % (24 * n - burst);
+
+      for(size_t i = 0; i != packets.size(); ++i)
+         if(i < start || i >= start + burst)
+            dec.add(packets[i].stripe, packets[i].id, packets[i].data.data());
+      dec.flush();
+
+      if(depth == 1)
+         check(dec.stripes_lost() > 0, "deinterleaver burst loss", k, n);
+      else
+         {
+         check(dec.stripes_lost() == 0, "deinterleaver lost", k, n);
+         check(output == input, "deinterleaver output", k, n);
+         check(std::count(seen.begin(), seen.end(), 1) == (int)seen.size(),
+               "deinterleaver output once", k, n);
+         }
+      }
+   }
+
+void test_redundancy_controller()
+   {
+   const size_t k = 16, max_n = 64;
+   fecpp::fec_redundancy_controller ctl(k, max_n);
+
+   check(ctl.get_N() == max_n, "controller initial N", k, max_n);
+
+   ctl.report(0, 1);
+   check(ctl.get_N() == k, "controller lossless N", k, max_n);
+
+   fecpp::fec_redundancy_controller random_loss(k, max_n);
+   fecpp::fec_redundancy_controller bursty_loss(k, max_n);
+
+   random_loss.report(0.05, 1);
+   bursty_loss.report(0.05, 4);
+
+   const size_t random_n = random_loss.get_N();
+   check(random_n > k && random_n < max_n, "controller random loss N", k, random_n);
+   check(bursty_loss.get_N() > random_n, "controller bursty loss N", k, random_n);
+
+   // estimates move gradually toward new reports
+   for(size_t i = 0; i != 200; ++i)
+      {
+      const size_t before = random_loss.get_N();
+      random_loss.report(0, 1);
+      check(random_loss.get_N() <= before, "controller decreasing N", k, before);
+      }
+   check(random_loss.get_N() == k, "controller recovered N", k, max_n);
+
+   ctl.report(1, 1);
+   check(ctl.get_N() > k, "controller total loss N", k, ctl.get_N());
+
+   // every code agrees on the shares they have in common
+   const size_t share_size = 1 + rand() % 100;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > full =
+      encode_all(fecpp::fec_code(k, max_n), input);
+
+   std::shared_ptr<const fecpp::fec_code> code = bursty_loss.code();
+   check(code->get_N() == bursty_loss.get_N(), "controller code N", k, max_n);
+   check(code == bursty_loss.code(), "controller code cached", k, max_n);
+
+   std::vector<std::vector<byte> > shares = encode_all(*code, input);
+   bool ok = true;
+   for(size_t i = 0; i != shares.size(); ++i)
+      ok = ok && shares[i] == full[i];
+   check(ok, "controller code shares", k, max_n);
+   }
+
+template<size_t K, size_t N>
+void test_fixed_code()
+   {
+   fecpp::fec_code code(K, N);
+   fecpp::fec_code_fixed<K, N> fixed;
+
+   const size_t sizes[] = { 1, 15, 16, 17, 100, 1024, 0 };
+
+   for(size_t s_i = 0; sizes[s_i]; ++s_i)
+      {
+      std::vector<byte> input = random_input(K * sizes[s_i]);
+      std::vector<std::vector<byte> > expected = encode_all(code, input);
+
+      std::vector<std::vector<byte> > shares(N);
+      fixed.encode(input.data(), input.size(),
+                   [&](size_t i, size_t n, const byte share[], size_t len)
+                      {
+                      check(n == N, "fixed code N", K, N);
+                      shares[i].assign(share, share + len);
+                      });
+
+      check(shares == expected, "fixed code shares", K, N);
+      }
+   }
+
+void test_jit_kernel()
+   {
+   const size_t params[][2] = { { 1, 2 }, { 4, 6 }, { 12, 16 }, { 10, 30 },
+                                { 64, 80 }, { 0 } };
+
+   for(size_t p = 0; params[p][0]; ++p)
+      {
+      const size_t k = params[p][0], n = params[p][1];
+      fecpp::fec_code code(k, n);
+
+      fecpp::fec_jit_kernel enc = fecpp::fec_jit_kernel::encoder(code);
+
+#if defined(FECPP_IS_X86) && defined(__x86_64__) && defined(__unix__)
+      check(enc.compiled(), "jit compiled", k, n);
+#endif
+
+      const size_t share_size = 1 + rand() % 1000;
+      std::vector<byte> input = random_input(k * share_size);
+      std::vector<std::vector<byte> > shares = encode_all(code, input);
+
+      std::vector<const byte*> in(k);
+      for(size_t i = 0; i != k; ++i)
+         in[i] = &input[i*share_size];
+
+      std::vector<std::vector<byte> > parity(n - k, std::vector<byte>(share_size, 0xAA));
+      std::vector<byte*> out(n - k);
+      for(size_t i = 0; i != n - k; ++i)
+         out[i] = parity[i].data();
+
+      enc.apply(in.data(), out.data(), share_size);
+
+      bool ok = true;
+      for(size_t i = 0; i != n - k; ++i)
+         ok = ok && parity[i] == shares[k + i];
+      check(ok, "jit encode", k, n);
+
+      // decode from a random choice of shares, in a random order
+      std::vector<size_t> ids(n);
+      for(size_t i = 0; i != n; ++i)
+         ids[i] = i;
+      std::shuffle(ids.begin(), ids.end(), rng);
+      ids.resize(k);
+
+      fecpp::fec_jit_kernel dec = fecpp::fec_jit_kernel::decoder(code, ids);
+
+      std::vector<const byte*> dec_in(k);
+      for(size_t i = 0; i != k; ++i)
+         dec_in[i] = shares[ids[i]].data();
+
+      std::vector<byte> output(input.size());
+      std::vector<byte*> dec_out(k);
+      for(size_t i = 0; i != k; ++i)
+         dec_out[i] = &output[i*share_size];
+
+      dec.apply(dec_in.data(), dec_out.data(), share_size);
+      check(output == input, "jit decode", k, n);
+      }
+
+   // sparse matrices, with more rows than fit in registers at once
+   const size_t rows = 19, cols = 7, size = 100;
+   std::vector<byte> matrix(rows * cols);
+   for(size_t i = 0; i != matrix.size(); ++i)
+      matrix[i] = (rand() % 3) ? rand() % 3 : rand();
+   std::fill(matrix.begin() + 2*cols, matrix.begin() + 3*cols, 0);
+
+   fecpp::fec_jit_kernel kernel(matrix.data(), rows, cols);
+
+   std::vector<byte> data = random_input(cols * size);
+   std::vector<const byte*> in(cols);
+   for(size_t i = 0; i != cols; ++i)
+      in[i] = &data[i*size];
+
+   std::vector<byte> result(rows * size, 0xAA);
+   std::vector<byte*> out(rows);
+   for(size_t i = 0; i != rows; ++i)
+      out[i] = &result[i*size];
+
+   kernel.apply(in.data(), out.data(), size);
+
+   bool ok = true;
+   for(size_t i = 0; i != rows; ++i)
+      for(size_t b = 0; b != size; ++b)
+         {
+         byte expected = 0;
+         for(size_t j = 0; j != cols; ++j)
+            expected ^= gf_mul(matrix[i*cols + j], data[j*size + b]);
+         ok = ok && result[i*size + b] == expected;
+         }
+   check(ok, "jit sparse matrix", rows, cols);
+   }
+
+void test_addmul_generic()
+   {
+   for(size_t y = 0; y != 256; ++y)
+      {
+      const size_t size = rand() % 100;
+      std::vector<byte> x = random_input(size), z = random_input(size);
+      std::vector<byte> expected = z;
+
+      const size_t left = fecpp::addmul_generic(z.data(), x.data(), y, size);
+
+      for(size_t i = 0; i != size - left; ++i)
+         expected[i] ^= gf_mul(x[i], y);
+
+      check(left == size % 16, "addmul_generic left over", y, size);
+      check(z == expected, "addmul_generic", y, size);
+      }
+   }
+
+void test_gf()
+   {
+   bool ok = true;
+   for(size_t a = 0; a != 256; ++a)
+      for(size_t b = 0; b != 256; ++b)
+         {
+         ok = ok && fecpp::gf::mul(a, b) == gf_mul(a, b);
+         if(b)
+            ok = ok && fecpp::gf::mul(fecpp::gf::div(a, b), b) == a;
+         }
+   check(ok, "gf::mul and gf::div", 0, 0);
+
+   bool threw = false;
+   try { fecpp::gf::inverse(0); }
+   catch(std::invalid_argument&) { threw = true; }
+   check(threw, "gf::inverse of zero", 0, 0);
+
+   for(size_t size = 0; size < 10000; size = size * 3 + 1)
+      {
+      const size_t rows = 3, cols = 5;
+      std::vector<byte> in = random_input(cols * size);
+      std::vector<byte> matrix = random_input(rows * cols);
+      std::vector<byte> out(rows * size), expected(rows * size);
+
+      const byte* in_ptrs[cols];
+      byte* out_ptrs[rows];
+      for(size_t j = 0; j != cols; ++j)
+         in_ptrs[j] = in.data() + j*size;
+      for(size_t i = 0; i != rows; ++i)
+         out_ptrs[i] = out.data() + i*size;
+
+      for(size_t i = 0; i != rows; ++i)
+         for(size_t j = 0; j != cols; ++j)
+            for(size_t b = 0; b != size; ++b)
+               expected[i*size + b] ^= gf_mul(matrix[i*cols + j], in[j*size + b]);
+
+      fecpp::gf::matrix_mul(matrix.data(), rows, cols, in_ptrs, out_ptrs, size);
+      check(out == expected, "gf::matrix_mul", size, 0);
+
+      std::vector<byte> z(size, 0xAA);
+      fecpp::gf::dot_region(z.data(), in_ptrs, matrix.data(), cols, size);
+      check(std::equal(z.begin(), z.end(), expected.begin()), "gf::dot_region", size, 0);
+
+      const byte y = matrix[0];
+      std::vector<byte> x(in.begin(), in.begin() + size), prod(size, 0x55);
+      fecpp::gf::mul_region(prod.data(), x.data(), y, size);
+      fecpp::gf::mul_region(x.data(), x.data(), y, size);
+
+      bool mul_ok = (x == prod);
+      for(size_t b = 0; b != size; ++b)
+         mul_ok = mul_ok && prod[b] == gf_mul(in[b], y);
+      check(mul_ok, "gf::mul_region", size, y);
+
+      fecpp::gf::addmul_region(x.data(), in.data(), y, size);
+      check(fecpp::is_zero(x.data(), size), "gf::addmul_region", size, y);
+      }
+   }
+
+void test_c_api(size_t k, size_t n)
+   {
+   fecpp_code* code = nullptr;
+   if(fecpp_code_create(&code, k, n) != FECPP_OK)
+      {
+      check(false, "fecpp_code_create", k, n);
+      return;
+      }
+
+   const size_t share_size = 1 + rand() % 200;
+   std::vector<byte> input = random_input(k * share_size);
+   std::vector<std::vector<byte> > shares =
+      encode_all(fecpp::fec_code(k, n), input);
+
+   std::vector<const byte*> data(k);
+   for(size_t i = 0; i != k; ++i)
+      data[i] = &input[i*share_size];
+
+   std::vector<byte> parity((n - k) * share_size);
+   std::vector<byte*> parity_ptrs(n - k);
+   for(size_t i = 0; i != n - k; ++i)
+      parity_ptrs[i] = &parity[i*share_size];
+
+   bool ok = fecpp_encode(code, data.data(), parity_ptrs.data(),
+                          share_size) == FECPP_OK;
+   for(size_t i = 0; i != n - k; ++i)
+      ok = ok && std::equal(shares[k+i].begin(), shares[k+i].end(),
+                            parity_ptrs[i]);
+   check(ok, "fecpp_encode", k, n);
+
+   // a random k shares, and a duplicate which must be ignored
+   std::vector<size_t> ids(n);
+   for(size_t i = 0; i != n; ++i)
+      ids[i] = i;
+   std::shuffle(ids.begin(), ids.end(), std::mt19937(rand()));
+   ids.resize(k);
+   ids.push_back(ids[0]);
+
+   std::vector<const byte*> have(ids.size());
+   for(size_t i = 0; i != ids.size(); ++i)
+      have[i] = &shares[ids[i]][0];
+
+   std::vector<byte> output(k * share_size);
+   std::vector<byte*> out(k);
+   for(size_t i = 0; i != k; ++i)
+      out[i] = &output[i*share_size];
+
+   check(fecpp_decode(code, ids.data(), have.data(), ids.size(), out.data(),
+                      share_size) == FECPP_OK && output == input,
+         "fecpp_decode", k, n);
+
+   check(fecpp_decode(code, ids.data(), have.data(), k - 1, out.data(),
+                      share_size) == FECPP_ERROR_SHARES,
+         "fecpp_decode too few shares", k, n);
+
+   ids[0] = n;
+   check(fecpp_decode(code, ids.data(), have.data(), ids.size(), out.data(),
+                      share_size) == FECPP_ERROR_ARGUMENT,
+         "fecpp_decode bad share id", k, n);
+
+   fecpp_code_destroy(code);
+   }
+
+}
+
+int main()
+   {
+   srand(0);
+
+   test_crc32c();
+   test_sha256();
+   test_is_zero();
+   test_window_code();
+   test_rlnc();
+   test_product_code();
+   test_interleaver();
+   test_redundancy_controller();
+   test_fixed_code<1, 1>();
+   test_fixed_code<1, 3>();
+   test_fixed_code<4, 6>();
+   test_fixed_code<10, 14>();
+   test_fixed_code<12, 16>();
+   test_fixed_code<32, 40>();
+   test_jit_kernel();
+   test_addmul_generic();
+   test_gf();
+
+   const int Ns[] = { 2, 3, 7, 16, 32, 64, 255, 256, 0 };
+   const int Ks[] = { 1, 2, 3, 5, 16, 17, 31, 64, 200, 0 };
+
+   for(int i = 0; Ns[i]; ++i)
+      {
+      for(int j = 0; Ks[j]; ++j)
+         {
+         const size_t k = Ks[j];
+         const size_t n = Ns[i];
+
+         if(k > n)
+            continue;
+
+         test_decode_range(k, n);
+         test_update_parity(k, n);
+         test_fec_encoder(k, n);
+         test_fec_decoder(k, n);
+         test_fec_stream_decoder(k, n);
+         test_share_generator(k, n);
+         test_encode_shares(k, n);
+         test_shared_codes(k, n);
+         test_decode_batch(k, n);
+         test_verify(k, n);
+         test_decode_correcting(k, n);
+         test_crc32c_codec(k, n);
+         test_hashed_codec(k, n);
+         test_sparse_encode(k, n);
+         test_packets(k, n);
+         test_c_api(k, n);
+         }
+      }
+
+   if(failures)
+      printf("%d failures\n", failures);
+   else
+      printf("All tests passed\n");
+
+   return failures ? 1 : 0;
+   }
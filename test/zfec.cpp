@@ -3,6 +3,11 @@
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 using fecpp::byte;
 
@@ -81,12 +86,21 @@ class zfec_file_writer
             write_zfec_header(*out, n, k, pad_bytes, i);
             outputs.push_back(out);
             }
+
+         ends_in_hole.resize(n);
          }
 
       ~zfec_file_writer()
          {
          for(size_t i = 0; i != outputs.size(); ++i)
             {
+            // seeking alone does not extend the file, so write the last byte
+            if(ends_in_hole[i])
+               {
+               outputs[i]->seekp(-1, std::ios::cur);
+               outputs[i]->put(0);
+               }
+
             outputs[i]->close();
             delete outputs[i];
             }
@@ -95,19 +109,71 @@ class zfec_file_writer
       void operator()(size_t block, size_t /*max_blocks*/,
                       const byte buf[], size_t buflen)
          {
-         outputs[block]->write((const char*)buf, buflen);
+         /*
+         Zero parts of the shares (common if the input is sparse) are
+         skipped over, leaving holes in the output files
+         */
+         ends_in_hole[block] = (buflen > 0 && fecpp::is_zero(buf, buflen));
+
+         if(ends_in_hole[block])
+            outputs[block]->seekp(buflen, std::ios::cur);
+         else
+            outputs[block]->write((const char*)buf, buflen);
          }
    private:
       // Have to use pointers instead of obj as copy constructor disabled
       std::vector<std::ofstream*> outputs;
+      std::vector<bool> ends_in_hole;
 };
 
+/*
+* Read len bytes at offset of fd into buf. Holes in the file, as
+* reported by SEEK_DATA and SEEK_HOLE, are filled with zeros instead
+* of being read.
+*/
+void read_sparse(int fd, byte buf[], size_t len, off_t offset)
+   {
+   while(len)
+      {
+      size_t data_len = len;
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+      off_t data = lseek(fd, offset, SEEK_DATA);
+
+      if(data < 0 && errno == ENXIO) // only a hole remains
+         data = offset + len;
+
+      if(data > offset)
+         {
+         const size_t zeros = std::min<size_t>(len, data - offset);
+         std::memset(buf, 0, zeros);
+         buf += zeros;
+         offset += zeros;
+         len -= zeros;
+         continue;
+         }
+
+      const off_t hole = lseek(fd, offset, SEEK_HOLE);
+      if(data == offset && hole > offset)
+         data_len = std::min<size_t>(len, hole - offset);
+#endif
+
+      const ssize_t got = pread(fd, buf, data_len, offset);
+
+      if(got <= 0)
+         throw std::runtime_error("Error reading input");
+
+      buf += got;
+      offset += got;
+      len -= got;
+      }
+   }
+
 }
 
 void zfec_encode(size_t k, size_t n,
                  const std::string& prefix,
-                 std::istream& in,
-                 size_t in_len)
+                 int fd, size_t in_len)
    {
    const size_t chunksize = 4096;
 
@@ -119,10 +185,11 @@ void zfec_encode(size_t k, size_t n,
 
    zfec_file_writer file_writer(prefix, n, k, pad_bytes);
 
-   while(in.good())
+   for(size_t offset = 0; offset < in_len; offset += buf.size())
       {
-      in.read((char*)&buf[0], buf.size());
-      size_t got = in.gcount();
+      const size_t got = std::min(buf.size(), in_len - offset);
+
+      read_sparse(fd, &buf[0], got, offset);
 
       if(got == buf.size())
          fec.encode(&buf[0], buf.size(), std::ref(file_writer));
@@ -138,13 +205,30 @@ void zfec_encode(size_t k, size_t n,
 
 void zfec_encode(size_t k, size_t n,
                  const std::string& prefix,
-                 std::ifstream& in)
+                 const char* filename)
    {
-   in.seekg (0, std::ios::end);
-   size_t in_length = in.tellg();
-   in.seekg (0, std::ios::beg);
+   int fd = open(filename, O_RDONLY);
+   if(fd < 0)
+      throw std::runtime_error(std::string("Failed to open ") + filename);
+
+   struct stat st;
+   if(fstat(fd, &st) != 0)
+      {
+      close(fd);
+      throw std::runtime_error(std::string("Failed to stat ") + filename);
+      }
 
-   zfec_encode(k, n, prefix, in, in_length);
+   try
+      {
+      zfec_encode(k, n, prefix, fd, st.st_size);
+      }
+   catch(...)
+      {
+      close(fd);
+      throw;
+      }
+
+   close(fd);
    }
 
 #include <stdlib.h>
@@ -157,10 +241,8 @@ int main(int argc, char* argv[])
       return 1;
       }
 
-   std::ifstream in(argv[1]);
-
    int k = atoi(argv[2]);
    int m = atoi(argv[3]);
 
-   zfec_encode(k, m, "fecpp/out", in);
+   zfec_encode(k, m, "fecpp/out", argv[1]);
    }